@@ -0,0 +1,121 @@
+#include "AdmissionController/AdmissionController.h"
+#include <algorithm>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr size_t MAX_BUCKETS = 65536;
+constexpr auto SWEEP_INTERVAL = milliseconds(100);      // 桶表满时两次清理的最小间隔
+
+//--------------------- 令牌桶 ---------------------
+TokenBucket::TokenBucket(const RateLimit& limit)
+    : limit_(limit), tokens_(limit.burst), lastRefill_(steady_clock::now()) {}
+
+void TokenBucket::refill(steady_clock::time_point now) {
+    double elapsed = duration<double>(now - lastRefill_).count();
+    tokens_ = min(limit_.burst, tokens_ + elapsed * limit_.ratePerSecond);
+    lastRefill_ = now;
+}
+
+bool TokenBucket::available() const {
+    return limit_.ratePerSecond <= 0 || tokens_ >= 1.0;
+}
+
+bool TokenBucket::full() const {
+    return limit_.ratePerSecond <= 0 || tokens_ >= limit_.burst;
+}
+
+void TokenBucket::consume() {
+    if(limit_.ratePerSecond > 0) {
+        tokens_ -= 1.0;
+    }
+}
+
+void TokenBucket::setLimit(const RateLimit& limit) {
+    limit_ = limit;
+    tokens_ = min(tokens_, limit.burst);
+}
+
+//--------------------- 准入控制 ---------------------
+// 桶表已满时清理回满的桶，返回是否有空位；清理限频，避免持续的新键让每次准入都遍历全表
+template<typename Key>
+static bool reserveBucket(unordered_map<Key, TokenBucket>& buckets,
+                          steady_clock::time_point now, steady_clock::time_point& lastSweep) {
+    if(buckets.size() < MAX_BUCKETS) return true;
+    if(now - lastSweep < SWEEP_INTERVAL) return false;
+
+    lastSweep = now;
+    for(auto it = buckets.begin(); it != buckets.end();) {
+        it->second.refill(now);
+        if(it->second.full()) {
+            it = buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return buckets.size() < MAX_BUCKETS;
+}
+
+AdmissionController::AdmissionController(RateLimit userLimit, RateLimit deviceLimit)
+    : userLimit_(userLimit), deviceLimit_(deviceLimit) {}
+
+bool AdmissionController::admit(const string& username, int deviceId) {
+    auto now = steady_clock::now();
+    lock_guard<mutex> lock(mutex_);
+
+    TokenBucket* userBucket = nullptr;
+    if(!username.empty()) {
+        auto userIt = userBuckets_.find(username);
+        if(userIt == userBuckets_.end()) {
+            if(!reserveBucket(userBuckets_, now, lastUserSweep_)) {
+                ++rejectedByUser_;
+                return false;
+            }
+            auto overrideIt = userOverrides_.find(username);
+            const RateLimit& limit = (overrideIt != userOverrides_.end()) ? overrideIt->second : userLimit_;
+            userIt = userBuckets_.emplace(username, TokenBucket(limit)).first;
+        }
+        userBucket = &userIt->second;
+    }
+    auto deviceIt = deviceBuckets_.find(deviceId);
+    if(deviceIt == deviceBuckets_.end()) {
+        if(!reserveBucket(deviceBuckets_, now, lastDeviceSweep_)) {
+            ++rejectedByDevice_;
+            return false;
+        }
+        deviceIt = deviceBuckets_.emplace(deviceId, TokenBucket(deviceLimit_)).first;
+    }
+
+    // 两个桶都有令牌时才同时扣减，被拒绝的请求不消耗任何配额
+    if(userBucket) {
+        userBucket->refill(now);
+        if(!userBucket->available()) {
+            ++rejectedByUser_;
+            return false;
+        }
+    }
+    deviceIt->second.refill(now);
+    if(!deviceIt->second.available()) {
+        ++rejectedByDevice_;
+        return false;
+    }
+
+    if(userBucket) userBucket->consume();
+    deviceIt->second.consume();
+    ++admitted_;
+    return true;
+}
+
+void AdmissionController::setUserLimit(const string& username, RateLimit limit) {
+    lock_guard<mutex> lock(mutex_);
+    userOverrides_[username] = limit;
+    auto it = userBuckets_.find(username);
+    if(it != userBuckets_.end()) {
+        it->second.setLimit(limit);
+    }
+}
+
+void AdmissionController::removeDevice(int deviceId) {
+    lock_guard<mutex> lock(mutex_);
+    deviceBuckets_.erase(deviceId);
+}
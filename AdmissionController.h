@@ -0,0 +1,64 @@
+#ifndef ADMISSION_CONTROLLER_H
+#define ADMISSION_CONTROLLER_H
+
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+// 速率限制配置，ratePerSecond<=0 表示不限速
+struct RateLimit {
+    double ratePerSecond;
+    double burst;
+};
+
+// 令牌桶（非线程安全，由AdmissionController加锁保护）
+class TokenBucket {
+public:
+    explicit TokenBucket(const RateLimit& limit);
+
+    void refill(std::chrono::steady_clock::time_point now);
+    bool available() const;
+    bool full() const;
+    void consume();
+    void setLimit(const RateLimit& limit);
+
+private:
+    RateLimit limit_;
+    double tokens_;
+    std::chrono::steady_clock::time_point lastRefill_;
+};
+
+// 命令准入控制：按用户和按设备的令牌桶限流，超限请求直接拒绝并计数
+// 令牌桶数量有上限：达到上限时清理已回满的桶（与新建的桶等价），仍无空位时拒绝新的用户/设备
+class AdmissionController {
+public:
+    AdmissionController(RateLimit userLimit = {20.0, 40.0}, RateLimit deviceLimit = {10.0, 20.0});
+
+    // username为空时（无会话的命令）只检查设备限流
+    bool admit(const std::string& username, int deviceId);
+
+    void setUserLimit(const std::string& username, RateLimit limit);
+    void removeDevice(int deviceId);
+
+    uint64_t admittedCount() const { return admitted_; }
+    uint64_t rejectedByUserCount() const { return rejectedByUser_; }
+    uint64_t rejectedByDeviceCount() const { return rejectedByDevice_; }
+
+private:
+    RateLimit userLimit_;
+    RateLimit deviceLimit_;
+    std::unordered_map<std::string, RateLimit> userOverrides_;
+    std::unordered_map<std::string, TokenBucket> userBuckets_;
+    std::unordered_map<int, TokenBucket> deviceBuckets_;
+    std::chrono::steady_clock::time_point lastUserSweep_;
+    std::chrono::steady_clock::time_point lastDeviceSweep_;
+    std::mutex mutex_;
+
+    std::atomic<uint64_t> admitted_{0};
+    std::atomic<uint64_t> rejectedByUser_{0};
+    std::atomic<uint64_t> rejectedByDevice_{0};
+};
+
+#endif // ADMISSION_CONTROLLER_H
@@ -0,0 +1,199 @@
+#include "DeviceManager/CommandCoalescer.h"
+#include <nlohmann/json.hpp>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+using namespace std::chrono;
+using json = nlohmann::json;
+
+CommandCoalescer::CommandCoalescer(DeviceManager& manager, milliseconds window)
+    : manager_(manager), window_(window)
+{
+    running_ = true;
+    flusher_ = thread(&CommandCoalescer::flusherLoop, this);
+}
+
+CommandCoalescer::~CommandCoalescer() {
+    shutdown();
+}
+
+bool CommandCoalescer::submit(int deviceId, const string& command) {
+    // 只取类型ID，不持有设备指针：提交期间设备可能被并发删除
+    DeviceTypeId typeId = manager_.getDeviceTypeId(deviceId);
+    if(typeId == INVALID_DEVICE_TYPE) return false;
+
+    json cmd;
+    try {
+        cmd = json::parse(command);
+    } catch(const json::exception& e) {
+        cerr << "命令解析失败: " << e.what() << endl;
+        return false;
+    }
+    if(!cmd.is_object()) return false;
+
+    // 任一字段不可合并时整条命令按原文保序执行
+    bool mergeable = true;
+    for(auto it = cmd.begin(); it != cmd.end(); ++it) {
+        if(!manager_.isMergeableField(typeId, it.key())) {
+            mergeable = false;
+            break;
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        if(!running_) return false;
+
+        auto [slotIt, created] = pending_.try_emplace(deviceId);
+        auto& commands = slotIt->second.commands;
+
+        if(mergeable && !commands.empty() && commands.back().mergeable) {
+            // 后写者胜：同名字段直接覆盖
+            for(auto it = cmd.begin(); it != cmd.end(); ++it) {
+                commands.back().fields[it.key()] = it.value().dump();
+            }
+        } else if(mergeable) {
+            PendingCommand pendingCommand{true, {}, ""};
+            for(auto it = cmd.begin(); it != cmd.end(); ++it) {
+                pendingCommand.fields[it.key()] = it.value().dump();
+            }
+            commands.push_back(move(pendingCommand));
+        } else {
+            commands.push_back({false, {}, command});
+        }
+
+        // 合并窗口从槽位内第一条命令开始计时，限制最大延迟
+        if(created) {
+            deadlines_.emplace(steady_clock::now() + window_, deviceId);
+        }
+    }
+    ++submitted_;
+    cv_.notify_one();
+    return true;
+}
+
+void CommandCoalescer::flusherLoop() {
+    while(running_) {
+        vector<Batch> ready;
+        {
+            unique_lock<mutex> lock(mutex_);
+            if(deadlines_.empty()) {
+                cv_.wait(lock, [this] { return !deadlines_.empty() || !running_; });
+                continue;
+            }
+            auto next = deadlines_.begin()->first;
+            if(steady_clock::now() < next) {
+                cv_.wait_until(lock, next);
+                continue;
+            }
+        }
+
+        // 先取执行锁再摘取槽位，保证同一设备的批次按顺序执行
+        lock_guard<mutex> applyLock(applyMutex_);
+        {
+            lock_guard<mutex> lock(mutex_);
+            auto now = steady_clock::now();
+            while(!deadlines_.empty() && deadlines_.begin()->first <= now) {
+                int deviceId = deadlines_.begin()->second;
+                deadlines_.erase(deadlines_.begin());
+
+                auto it = pending_.find(deviceId);
+                if(it != pending_.end()) {
+                    ready.emplace_back(deviceId, move(it->second.commands));
+                    pending_.erase(it);
+                }
+            }
+        }
+        applyBatches(ready, true);
+    }
+}
+
+// 各设备的批次提交到各自的strand并行执行，全部完成后才返回（调用方需持有applyMutex_），
+// 下一轮批次因此不会越过本轮同一设备的命令
+void CommandCoalescer::applyBatches(vector<Batch>& ready, bool checkAdmission) {
+    vector<future<bool>> results;
+    for(auto& [deviceId, commands] : ready) {
+        if(commands.empty()) continue;
+        if(checkAdmission && !manager_.admitCommand(deviceId)) {
+            lock_guard<mutex> lock(mutex_);
+            requeue(deviceId, move(commands));
+            continue;
+        }
+
+        for(const auto& pendingCommand : commands) {
+            string command;
+            if(pendingCommand.mergeable) {
+                command = "{";
+                for(const auto& [field, value] : pendingCommand.fields) {
+                    if(command.size() > 1) command += ",";
+                    command += json(field).dump() + ":" + value;
+                }
+                command += "}";
+            } else {
+                command = pendingCommand.raw;
+            }
+            results.push_back(manager_.dispatchDeviceStatus(deviceId, command));
+            ++applied_;
+        }
+    }
+    for(auto& result : results) {
+        result.wait();
+    }
+}
+
+// 被限流拒绝的批次放回槽位最前面，之后到达的可合并字段覆盖其中的旧值（调用方需持有mutex_）
+void CommandCoalescer::requeue(int deviceId, vector<PendingCommand> commands) {
+    auto [slotIt, created] = pending_.try_emplace(deviceId);
+    auto& newer = slotIt->second.commands;
+
+    auto next = newer.begin();
+    if(next != newer.end() && next->mergeable && commands.back().mergeable) {
+        for(auto& [field, value] : next->fields) {
+            commands.back().fields[field] = move(value);
+        }
+        ++next;
+    }
+    commands.insert(commands.end(), make_move_iterator(next), make_move_iterator(newer.end()));
+    newer = move(commands);
+
+    if(created) {
+        deadlines_.emplace(steady_clock::now() + window_, deviceId);
+    }
+}
+
+void CommandCoalescer::flush() {
+    vector<Batch> ready;
+    lock_guard<mutex> applyLock(applyMutex_);
+    {
+        lock_guard<mutex> lock(mutex_);
+        for(const auto& [time, deviceId] : deadlines_) {
+            auto it = pending_.find(deviceId);
+            if(it != pending_.end()) {
+                ready.emplace_back(deviceId, move(it->second.commands));
+                pending_.erase(it);
+            }
+        }
+        deadlines_.clear();
+    }
+    applyBatches(ready, false);
+}
+
+void CommandCoalescer::setWindow(milliseconds window) {
+    lock_guard<mutex> lock(mutex_);
+    window_ = window;
+}
+
+void CommandCoalescer::shutdown() {
+    if(running_) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        if(flusher_.joinable()) {
+            flusher_.join();
+        }
+        flush();
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef COMMAND_COALESCER_H
+#define COMMAND_COALESCER_H
+
+#include "DeviceManager/DeviceManager.h"
+#include <map>
+#include <vector>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+
+// 命令合并阶段：每个设备一个待执行槽位，在合并窗口内
+// 幂等字段按"后写者胜"合并，只有最终状态会被执行和持久化；
+// 不可合并的命令（如温控器相对调节）保持原有顺序逐条执行。
+// 限流按合并后的批次检查，被拒绝的批次留在槽位中继续合并，下个窗口重试，最终值不会被丢弃
+class CommandCoalescer {
+public:
+    explicit CommandCoalescer(DeviceManager& manager,
+                              std::chrono::milliseconds window = std::chrono::milliseconds(50));
+    ~CommandCoalescer();
+
+    CommandCoalescer(const CommandCoalescer&) = delete;
+    CommandCoalescer& operator=(const CommandCoalescer&) = delete;
+
+    // 提交命令，命令格式错误或设备不存在时返回false
+    bool submit(int deviceId, const std::string& command);
+
+    // 立即执行所有待处理命令（不受限流约束）
+    void flush();
+    void setWindow(std::chrono::milliseconds window);
+    void shutdown();
+
+    uint64_t submittedCount() const { return submitted_; }
+    uint64_t appliedCount() const { return applied_; }
+
+private:
+    struct PendingCommand {
+        bool mergeable;
+        std::map<std::string, std::string> fields;   // 字段名 -> JSON值
+        std::string raw;                             // 不可合并命令的原文
+    };
+
+    struct PendingSlot {
+        std::vector<PendingCommand> commands;
+    };
+
+    DeviceManager& manager_;
+    std::unordered_map<int, PendingSlot> pending_;
+    // 按截止时间排序：窗口调整后新旧槽位的截止时间可能交错
+    std::multimap<std::chrono::steady_clock::time_point, int> deadlines_;
+    std::chrono::milliseconds window_;
+    std::mutex mutex_;
+    std::mutex applyMutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> running_{false};
+    std::thread flusher_;
+
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> applied_{0};
+
+    using Batch = std::pair<int, std::vector<PendingCommand>>;
+
+    void flusherLoop();
+    void applyBatches(std::vector<Batch>& ready, bool checkAdmission);
+    void requeue(int deviceId, std::vector<PendingCommand> commands);
+};
+
+#endif // COMMAND_COALESCER_H
@@ -1,7 +1,13 @@
 #include "DatabaseManager.h"
+#include "DatabaseManager/LogDeviceStore.h"
 #include <iostream>
 
-DatabaseManager::DatabaseManager(const std::string& db_name) {
+// 多个连接写同一文件时等待锁释放，而不是立即返回SQLITE_BUSY
+constexpr int BUSY_TIMEOUT_MS = 5000;
+
+DatabaseManager::DatabaseManager(const std::string& db_name, StorageEngine engine,
+                                 const std::string& devicesLogPath)
+    : engine_(engine) {
     int rc = sqlite3_open(db_name.c_str(), &db_);
     if (rc != SQLITE_OK) {
         std::string err_msg = "Database error: ";
@@ -9,16 +15,35 @@ DatabaseManager::DatabaseManager(const std::string& db_name) {
         sqlite3_close(db_);
         throw std::runtime_error(err_msg);
     }
+    sqlite3_busy_timeout(db_, BUSY_TIMEOUT_MS);
     createTables();
+
+    if(engine == StorageEngine::LOG_STRUCTURED) {
+        std::string logPath = devicesLogPath.empty() ? db_name + ".devlog" : devicesLogPath;
+        try {
+            deviceStore_ = std::make_unique<LogDeviceStore>(logPath);
+        } catch(...) {
+            sqlite3_close(db_);
+            throw;
+        }
+    } else {
+        deviceStore_ = std::make_unique<SqliteDeviceStore>(db_);
+    }
 }
 
 DatabaseManager::~DatabaseManager() {
+    // 先关闭设备存储，确保待提交的状态写完
+    deviceStore_.reset();
     sqlite3_close(db_);
 }
 
 void DatabaseManager::executeSQL(const std::string& sql) {
+    executeSQL(db_, sql);
+}
+
+void DatabaseManager::executeSQL(sqlite3* handle, const std::string& sql) {
     char* errMsg = nullptr;
-    int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &errMsg);
+    int rc = sqlite3_exec(handle, sql.c_str(), nullptr, nullptr, &errMsg);
     if (rc != SQLITE_OK) {
         std::string error = "SQL error: ";
         error += errMsg;
@@ -27,6 +52,21 @@ void DatabaseManager::executeSQL(const std::string& sql) {
     }
 }
 
+sqlite3* DatabaseManager::openConnection() const {
+    const char* file = sqlite3_db_filename(db_, "main");
+    if (!file || !*file) {
+        return nullptr;
+    }
+    sqlite3* handle = nullptr;
+    if (sqlite3_open(file, &handle) != SQLITE_OK) {
+        std::cerr << "数据库连接打开失败: " << sqlite3_errmsg(handle) << std::endl;
+        sqlite3_close(handle);
+        return nullptr;
+    }
+    sqlite3_busy_timeout(handle, BUSY_TIMEOUT_MS);
+    return handle;
+}
+
 void DatabaseManager::createTables() {
     executeSQL(
         "CREATE TABLE IF NOT EXISTS users ("
@@ -54,4 +94,43 @@ void DatabaseManager::createTables() {
         "FOREIGN KEY(user_id) REFERENCES users(id),"
         "FOREIGN KEY(device_id) REFERENCES devices(id));"
     );
+
+    // 设备权限：subject为用户名或角色名，device_id为空表示所有设备
+    // operations为位掩码（READ=1, CONTROL=2, MANAGE=4）
+    executeSQL(
+        "CREATE TABLE IF NOT EXISTS permissions ("
+        "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+        "subject_type TEXT CHECK(subject_type IN ('user', 'role')) NOT NULL,"
+        "subject TEXT NOT NULL,"
+        "device_id INTEGER,"
+        "operations INTEGER NOT NULL);"
+    );
+
+    executeSQL(
+        "CREATE INDEX IF NOT EXISTS idx_permissions_subject "
+        "ON permissions(subject_type, subject);"
+    );
+
+    // 设备分组（房间）标签，供二级索引按分组查询
+    executeSQL(
+        "CREATE TABLE IF NOT EXISTS device_groups ("
+        "device_id INTEGER PRIMARY KEY,"
+        "group_name TEXT NOT NULL);"
+    );
+
+    // 配置文件中的稳定设备键与设备ID的绑定，用于配置热加载时计算差异
+    executeSQL(
+        "CREATE TABLE IF NOT EXISTS device_config ("
+        "config_key TEXT PRIMARY KEY,"
+        "device_id INTEGER NOT NULL,"
+        "device_type TEXT NOT NULL,"
+        "config TEXT NOT NULL);"
+    );
+
+    // 一次性数据迁移的状态（如升级时认领旧设备），保证迁移只执行一次
+    executeSQL(
+        "CREATE TABLE IF NOT EXISTS schema_migrations ("
+        "name TEXT PRIMARY KEY,"
+        "state TEXT NOT NULL);"
+    );
 }
@@ -3,17 +3,39 @@
 
 #include <sqlite3.h>
 #include <string>
+#include <memory>
 #include <stdexcept>
+#include "DatabaseManager/DeviceStateStore.h"
+
+// 设备状态存储引擎，用户、权限、日志等始终使用SQLite
+enum class StorageEngine {
+    SQLITE,
+    LOG_STRUCTURED
+};
 
 class DatabaseManager {
 public:
-    explicit DatabaseManager(const std::string& db_name);
+    // LOG_STRUCTURED 模式下设备状态写入 devicesLogPath（为空时使用 db_name + ".devlog"）
+    explicit DatabaseManager(const std::string& db_name,
+                             StorageEngine engine = StorageEngine::SQLITE,
+                             const std::string& devicesLogPath = "");
     ~DatabaseManager();
 
+    void executeSQL(const std::string& sql);
+    static void executeSQL(sqlite3* handle, const std::string& sql);
+    sqlite3* getHandle() const { return db_; }
+    DeviceStateStore& deviceStore() { return *deviceStore_; }
+    StorageEngine engine() const { return engine_; }
+
+    // 打开同一数据库文件的独立连接，用于不希望卷入共享连接上其他写入的事务；
+    // 调用方负责sqlite3_close。内存/临时数据库无法共享，返回nullptr
+    sqlite3* openConnection() const;
+
 private:
     sqlite3* db_;
+    StorageEngine engine_;
+    std::unique_ptr<DeviceStateStore> deviceStore_;
     
-    void executeSQL(const std::string& sql);
     void createTables();
 };
 
@@ -0,0 +1,249 @@
+#include "DeviceManager/DeviceIndex.h"
+#include <mutex>
+#include <limits>
+
+using namespace std;
+
+//--------------------- 索引维护 ---------------------
+void DeviceIndex::update(int deviceId, DeviceTypeId typeId, const DeviceIndexFields& fields) {
+    unique_lock<shared_mutex> lock(mutex_);
+
+    auto it = entries_.find(deviceId);
+    if(it == entries_.end()) {
+        Entry entry{allocateSlot(deviceId), typeId, "", {}};
+        it = entries_.emplace(deviceId, move(entry)).first;
+        byType_[typeId].insert(deviceId);
+    } else if(it->second.typeId != typeId) {
+        byType_[it->second.typeId].erase(deviceId);
+        byType_[typeId].insert(deviceId);
+        it->second.typeId = typeId;
+    }
+    Entry& entry = it->second;
+
+    for(const auto& [field, value] : fields.flags) {
+        FlagIndex& index = bitmaps_[field];
+        setBit(index.present, entry.slot, true);
+        setBit(index.value, entry.slot, value);
+    }
+
+    // 数值未变化时跳过，避免有序索引的删除/插入
+    for(const auto& [field, value] : fields.numbers) {
+        auto pos = entry.numbers.find(field);
+        if(pos != entry.numbers.end()) {
+            if(pos->second->first == value) continue;
+            ordered_[field].erase(pos->second);
+            pos->second = ordered_[field].emplace(value, deviceId);
+        } else {
+            entry.numbers.emplace(field, ordered_[field].emplace(value, deviceId));
+        }
+    }
+}
+
+void DeviceIndex::remove(int deviceId) {
+    unique_lock<shared_mutex> lock(mutex_);
+    removeLocked(deviceId);
+}
+
+void DeviceIndex::removeLocked(int deviceId) {
+    auto it = entries_.find(deviceId);
+    if(it == entries_.end()) return;
+    Entry& entry = it->second;
+
+    byType_[entry.typeId].erase(deviceId);
+    if(!entry.group.empty()) {
+        byGroup_[entry.group].erase(deviceId);
+    }
+    for(auto& [field, index] : bitmaps_) {
+        setBit(index.present, entry.slot, false);
+        setBit(index.value, entry.slot, false);
+    }
+    for(auto& [field, pos] : entry.numbers) {
+        ordered_[field].erase(pos);
+    }
+
+    setBit(occupied_, entry.slot, false);
+    slotDevices_[entry.slot] = -1;
+    freeSlots_.push_back(entry.slot);
+    entries_.erase(it);
+}
+
+bool DeviceIndex::setGroup(int deviceId, const string& group) {
+    unique_lock<shared_mutex> lock(mutex_);
+    auto it = entries_.find(deviceId);
+    if(it == entries_.end()) return false;
+
+    Entry& entry = it->second;
+    if(!entry.group.empty()) {
+        byGroup_[entry.group].erase(deviceId);
+    }
+    entry.group = group;
+    if(!group.empty()) {
+        byGroup_[group].insert(deviceId);
+    }
+    return true;
+}
+
+void DeviceIndex::clear() {
+    unique_lock<shared_mutex> lock(mutex_);
+    entries_.clear();
+    slotDevices_.clear();
+    freeSlots_.clear();
+    occupied_.clear();
+    byType_.clear();
+    byGroup_.clear();
+    bitmaps_.clear();
+    ordered_.clear();
+}
+
+uint32_t DeviceIndex::allocateSlot(int deviceId) {
+    uint32_t slot;
+    if(!freeSlots_.empty()) {
+        slot = freeSlots_.back();
+        freeSlots_.pop_back();
+        slotDevices_[slot] = deviceId;
+    } else {
+        slot = static_cast<uint32_t>(slotDevices_.size());
+        slotDevices_.push_back(deviceId);
+    }
+    setBit(occupied_, slot, true);
+    return slot;
+}
+
+//--------------------- 查询 ---------------------
+vector<int> DeviceIndex::query(const DeviceQuery& query, DeviceTypeId typeId) const {
+    shared_lock<shared_mutex> lock(mutex_);
+    vector<int> result;
+
+    // 选择候选集最小的索引作为驱动，其余条件逐个校验
+    const unordered_set<int>* driverSet = nullptr;
+    size_t best = numeric_limits<size_t>::max();
+
+    if(!query.type.empty()) {
+        auto it = byType_.find(typeId);
+        if(it == byType_.end()) return result;
+        driverSet = &it->second;
+        best = driverSet->size();
+    }
+    if(!query.group.empty()) {
+        auto it = byGroup_.find(query.group);
+        if(it == byGroup_.end()) return result;
+        if(it->second.size() < best) {
+            driverSet = &it->second;
+            best = driverSet->size();
+        }
+    }
+
+    // 范围条件只计数到当前最优值为止，不会退化为全量遍历
+    OrderedIndex::const_iterator rangeBegin, rangeEnd;
+    bool rangeDriver = false;
+    for(const auto& range : query.ranges) {
+        // 空区间或NaN边界：lower_bound会越过upper_bound，直接返回空
+        if(!(range.min <= range.max)) return result;
+
+        auto it = ordered_.find(range.field);
+        if(it == ordered_.end()) return result;
+
+        auto lo = it->second.lower_bound(range.min);
+        auto hi = it->second.upper_bound(range.max);
+        size_t count = 0;
+        for(auto pos = lo; pos != hi && count < best; ++pos) {
+            ++count;
+        }
+        if(count < best) {
+            best = count;
+            rangeBegin = lo;
+            rangeEnd = hi;
+            rangeDriver = true;
+            driverSet = nullptr;
+        }
+    }
+
+    if(rangeDriver) {
+        for(auto pos = rangeBegin; pos != rangeEnd; ++pos) {
+            if(matches(entries_.at(pos->second), query, typeId)) {
+                result.push_back(pos->second);
+            }
+        }
+        return result;
+    }
+
+    if(driverSet) {
+        result.reserve(driverSet->size());
+        for(int deviceId : *driverSet) {
+            if(matches(entries_.at(deviceId), query, typeId)) {
+                result.push_back(deviceId);
+            }
+        }
+        return result;
+    }
+
+    if(query.flags.empty()) {
+        result.reserve(entries_.size());
+        for(const auto& [deviceId, entry] : entries_) {
+            result.push_back(deviceId);
+        }
+        return result;
+    }
+
+    // 仅有布尔条件时按64位字批量求交
+    Bitmap candidates = occupied_;
+    for(const auto& [field, value] : query.flags) {
+        auto it = bitmaps_.find(field);
+        if(it == bitmaps_.end()) return result;
+        const FlagIndex& index = it->second;
+
+        for(size_t w = 0; w < candidates.size(); ++w) {
+            uint64_t present = w < index.present.size() ? index.present[w] : 0;
+            uint64_t bits = w < index.value.size() ? index.value[w] : 0;
+            candidates[w] &= value ? bits : (present & ~bits);
+        }
+    }
+
+    for(size_t w = 0; w < candidates.size(); ++w) {
+        uint64_t word = candidates[w];
+        while(word) {
+            uint32_t slot = static_cast<uint32_t>(w * 64 + __builtin_ctzll(word));
+            result.push_back(slotDevices_[slot]);
+            word &= word - 1;
+        }
+    }
+    return result;
+}
+
+bool DeviceIndex::matches(const Entry& entry, const DeviceQuery& query, DeviceTypeId typeId) const {
+    if(!query.type.empty() && entry.typeId != typeId) return false;
+    if(!query.group.empty() && entry.group != query.group) return false;
+
+    for(const auto& [field, value] : query.flags) {
+        auto it = bitmaps_.find(field);
+        if(it == bitmaps_.end() || !testBit(it->second.present, entry.slot)) return false;
+        if(testBit(it->second.value, entry.slot) != value) return false;
+    }
+
+    for(const auto& range : query.ranges) {
+        auto it = entry.numbers.find(range.field);
+        if(it == entry.numbers.end()) return false;
+        double value = it->second->first;
+        if(value < range.min || value > range.max) return false;
+    }
+    return true;
+}
+
+void DeviceIndex::setBit(Bitmap& bitmap, uint32_t slot, bool value) {
+    size_t word = slot / 64;
+    if(word >= bitmap.size()) {
+        if(!value) return;
+        bitmap.resize(word + 1, 0);
+    }
+    uint64_t mask = uint64_t(1) << (slot % 64);
+    if(value) {
+        bitmap[word] |= mask;
+    } else {
+        bitmap[word] &= ~mask;
+    }
+}
+
+bool DeviceIndex::testBit(const Bitmap& bitmap, uint32_t slot) {
+    size_t word = slot / 64;
+    return word < bitmap.size() && (bitmap[word] >> (slot % 64)) & 1;
+}
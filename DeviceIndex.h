@@ -0,0 +1,89 @@
+#ifndef DEVICE_INDEX_H
+#define DEVICE_INDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+#include <cstdint>
+
+// 设备类型ID，在工厂注册时分配一次，之后按整数分发
+using DeviceTypeId = uint16_t;
+
+// 设备上报的可索引字段：布尔字段进位图索引，数值字段进有序索引
+struct DeviceIndexFields {
+    std::vector<std::pair<std::string, bool>> flags;
+    std::vector<std::pair<std::string, double>> numbers;
+};
+
+// 设备查询条件，各条件之间为AND关系，空条件表示不限
+struct DeviceQuery {
+    struct Range {
+        std::string field;
+        double min;
+        double max;
+    };
+
+    std::string type;
+    std::string group;
+    std::vector<std::pair<std::string, bool>> flags;
+    std::vector<Range> ranges;
+
+    DeviceQuery& ofType(const std::string& value) { type = value; return *this; }
+    DeviceQuery& inGroup(const std::string& value) { group = value; return *this; }
+    DeviceQuery& where(const std::string& field, bool value) { flags.emplace_back(field, value); return *this; }
+    DeviceQuery& between(const std::string& field, double min, double max) { ranges.push_back({field, min, max}); return *this; }
+};
+
+// 设备二级索引：类型/分组哈希索引、布尔字段位图索引、数值字段有序索引
+// 由DeviceManager在设备状态变化时增量维护
+class DeviceIndex {
+public:
+    void update(int deviceId, DeviceTypeId typeId, const DeviceIndexFields& fields);
+    void remove(int deviceId);
+    bool setGroup(int deviceId, const std::string& group);
+    void clear();
+
+    // typeId 为 DeviceQuery::type 解析后的结果，未指定类型时忽略
+    std::vector<int> query(const DeviceQuery& query, DeviceTypeId typeId) const;
+
+private:
+    using OrderedIndex = std::multimap<double, int>;
+    using Bitmap = std::vector<uint64_t>;
+
+    struct FlagIndex {
+        Bitmap present;
+        Bitmap value;
+    };
+
+    struct Entry {
+        uint32_t slot;
+        DeviceTypeId typeId;
+        std::string group;
+        std::unordered_map<std::string, OrderedIndex::iterator> numbers;
+    };
+
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<int, Entry> entries_;
+
+    // 位图按稠密槽位编号，删除的槽位回收复用
+    std::vector<int> slotDevices_;
+    std::vector<uint32_t> freeSlots_;
+    Bitmap occupied_;
+
+    std::unordered_map<DeviceTypeId, std::unordered_set<int>> byType_;
+    std::unordered_map<std::string, std::unordered_set<int>> byGroup_;
+    std::unordered_map<std::string, FlagIndex> bitmaps_;
+    std::unordered_map<std::string, OrderedIndex> ordered_;
+
+    uint32_t allocateSlot(int deviceId);
+    void removeLocked(int deviceId);
+    bool matches(const Entry& entry, const DeviceQuery& query, DeviceTypeId typeId) const;
+
+    static void setBit(Bitmap& bitmap, uint32_t slot, bool value);
+    static bool testBit(const Bitmap& bitmap, uint32_t slot);
+};
+
+#endif // DEVICE_INDEX_H
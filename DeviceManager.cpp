@@ -1,17 +1,34 @@
 #include "DeviceManager/DeviceManager.h"
 #include "DatabaseManager/DatabaseManager.h"
+#include "TraceRecorder/TraceRecorder.h"
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <sqlite3.h>
 #include <algorithm>
+#include <filesystem>
+#include <cstring>
+#include <random>
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+#include <unordered_set>
 
 using namespace std;
 using json = nlohmann::json;
 
+// 升级时把旧设备认领为配置条目的一次性迁移
+static const string CONFIG_ADOPTION_MIGRATION = "device_config_adoption";
+
 //--------------------- 具体设备实现 ---------------------
 class Light : public Device {
 public:
+    static constexpr const char* TYPE_NAME = "light";
+    static constexpr DeviceTypeId TYPE_ID = 0;
+
     Light(int id, const string& config) : id_(id) {
         try {
             json configJson = json::parse(config);
@@ -23,7 +40,12 @@ public:
         }
     }
 
-    string getType() const override { return "light"; }
+    const string& getType() const override {
+        static const string type(TYPE_NAME);
+        return type;
+    }
+
+    DeviceTypeId getTypeId() const override { return TYPE_ID; }
     
     string getStatus() const override {
         json status;
@@ -44,14 +66,16 @@ public:
     }
 
     void updateDatabase(DatabaseManager& db) override {
-        stringstream ss;
-        ss << "UPDATE devices SET status = '" << getStatus() 
-           << "', last_modified = CURRENT_TIMESTAMP WHERE id = " << id_;
-        db.executeSQL(ss.str());
+        db.deviceStore().updateDevice(id_, getType(), getStatus());
     }
 
     int getId() const override { return id_; }
 
+    void getIndexFields(DeviceIndexFields& fields) const override {
+        fields.flags.emplace_back("power", isOn_);
+        fields.numbers.emplace_back("brightness", brightness_);
+    }
+
 private:
     int id_;
     bool isOn_;
@@ -60,6 +84,9 @@ private:
 
 class Thermostat : public Device {
 public:
+    static constexpr const char* TYPE_NAME = "thermostat";
+    static constexpr DeviceTypeId TYPE_ID = 1;
+
     Thermostat(int id, const string& config) : id_(id) {
         try {
             json configJson = json::parse(config);
@@ -71,7 +98,12 @@ public:
         }
     }
 
-    string getType() const override { return "thermostat"; }
+    const string& getType() const override {
+        static const string type(TYPE_NAME);
+        return type;
+    }
+
+    DeviceTypeId getTypeId() const override { return TYPE_ID; }
     
     string getStatus() const override {
         json status;
@@ -85,49 +117,104 @@ public:
         if(cmd.contains("targetTemp")) {
             targetTemp_ = clamp(cmd["targetTemp"].get<double>(), 10.0, 30.0);
         }
+        // 相对调节：在当前目标温度基础上增减
+        if(cmd.contains("targetTempStep")) {
+            targetTemp_ = clamp(targetTemp_ + cmd["targetTempStep"].get<double>(), 10.0, 30.0);
+        }
         // 模拟温度变化
         currentTemp_ += (targetTemp_ - currentTemp_) * 0.1;
     }
 
     void updateDatabase(DatabaseManager& db) override {
-        stringstream ss;
-        ss << "UPDATE devices SET status = '" << getStatus() 
-           << "', last_modified = CURRENT_TIMESTAMP WHERE id = " << id_;
-        db.executeSQL(ss.str());
+        db.deviceStore().updateDevice(id_, getType(), getStatus());
     }
 
     int getId() const override { return id_; }
 
+    void getIndexFields(DeviceIndexFields& fields) const override {
+        fields.numbers.emplace_back("currentTemp", currentTemp_);
+        fields.numbers.emplace_back("targetTemp", targetTemp_);
+    }
+
+    static bool isMergeableField(const string& field) {
+        return field != "targetTempStep";
+    }
+
 private:
     int id_;
     double currentTemp_;
     double targetTemp_;
 };
 
+// 内置设备类型（新增类型时在此追加，TYPE_ID取其在列表中的下标，registerFactories中静态检查）
+using BuiltinDeviceTypes = DeviceTypeList<Light, Thermostat>;
+
 //--------------------- 设备管理器实现 ---------------------
+template<typename F>
+auto DeviceManager::runOnStrand(int deviceId, F&& task) -> decltype(task()) {
+    if(!executor_) {
+        return task();
+    }
+    return executor_->submit(deviceId, forward<F>(task)).get();
+}
+
 DeviceManager::DeviceManager(DatabaseManager& db, const string& configPath) 
     : db_(db) 
 {
     // 注册设备工厂
-    registerFactory("light", make_unique<DeviceFactoryImpl<Light>>());
-    registerFactory("thermostat", make_unique<DeviceFactoryImpl<Thermostat>>());
-    // 可扩展其他设备类型...
+    registerFactories(BuiltinDeviceTypes{});
 
-    // 初始化设备
+    // 初始化设备：先从存储加载，再与配置文件做差异（configPath为空时跳过，供分片使用）
     try {
-        loadConfigurations(configPath);
         loadDevices();
+        prepareConfigAdoption();
     } catch(const exception& e) {
         cerr << "设备初始化失败: " << e.what() << endl;
     }
+    if(!configPath.empty()) {
+        reloadConfigurations(configPath);
+    }
+    traceDeviceSnapshot();
 }
 
-void DeviceManager::registerFactory(const string& type, unique_ptr<DeviceFactory> factory) {
+DeviceManager::~DeviceManager() {
+    stopConfigWatch();
+}
+
+void DeviceManager::registerFactory(const string& type, DeviceTypeId typeId, unique_ptr<DeviceFactory> factory,
+                                    MergeRule mergeRule) {
+    lock_guard<mutex> lock(devicesMutex_);
+    if(factories_.size() <= typeId) {
+        factories_.resize(typeId + 1);
+        mergeRules_.resize(typeId + 1);
+    }
+    factories_[typeId] = move(factory);
+    mergeRules_[typeId] = mergeRule;
+    typeIds_[type] = typeId;
+}
+
+DeviceTypeId DeviceManager::resolveType(const string& type) const {
+    auto it = typeIds_.find(type);
+    return (it != typeIds_.end()) ? it->second : INVALID_DEVICE_TYPE;
+}
+
+DeviceTypeId DeviceManager::getDeviceTypeId(int deviceId) {
     lock_guard<mutex> lock(devicesMutex_);
-    factories_.emplace(type, move(factory));
+    auto it = devices_.find(deviceId);
+    return (it != devices_.end()) ? it->second->getTypeId() : INVALID_DEVICE_TYPE;
 }
 
-void DeviceManager::loadConfigurations(const string& path) {
+bool DeviceManager::isMergeableField(DeviceTypeId typeId, const string& field) const {
+    return typeId < mergeRules_.size() && mergeRules_[typeId] && mergeRules_[typeId](field);
+}
+
+DeviceFactory* DeviceManager::findFactory(const string& type) const {
+    DeviceTypeId typeId = resolveType(type);
+    return (typeId != INVALID_DEVICE_TYPE) ? factories_[typeId].get() : nullptr;
+}
+
+//--------------------- 配置热加载 ---------------------
+vector<DeviceManager::ConfigEntry> DeviceManager::parseConfigurations(const string& path) {
     ifstream configFile(path);
     if(!configFile.is_open()) {
         throw runtime_error("配置文件打开失败: " + path);
@@ -140,59 +227,516 @@ void DeviceManager::loadConfigurations(const string& path) {
         throw runtime_error("配置文件解析错误: " + string(e.what()));
     }
 
-    for(const auto& deviceConfig : config["devices"]) {
-        string type = deviceConfig["type"];
-        string configStr = deviceConfig["config"].dump();
-        addDevice(type, configStr);
+    // 稳定设备键优先取"key"字段；未配置时由类型和配置内容派生，内容完全相同的条目再按出现次序区分，
+    // 与条目在文件中的位置无关。修改无key条目的配置相当于删除旧设备并新增设备
+    vector<ConfigEntry> entries;
+    unordered_map<string, int> contentCounts;
+    for(const auto& deviceConfig : config.value("devices", json::array())) {
+        string type = deviceConfig.at("type");
+        string configStr = deviceConfig.value("config", json::object()).dump();
+        string key;
+        if(deviceConfig.contains("key")) {
+            key = deviceConfig["key"].get<string>();
+        } else {
+            string content = type + "|" + configStr;
+            key = content + "#" + to_string(contentCounts[content]++);
+        }
+        entries.push_back({key, type, configStr});
     }
+    return entries;
 }
 
-void DeviceManager::loadDevices() {
-    lock_guard<mutex> lock(devicesMutex_);
-    
-    const char* sql = "SELECT id, device_type, status FROM devices;";
+unordered_map<string, DeviceManager::ConfigBinding> DeviceManager::loadConfigBindings() {
+    unordered_map<string, ConfigBinding> bindings;
+    const char* sql = "SELECT config_key, device_id, device_type, config FROM device_config;";
     sqlite3_stmt* stmt;
 
     if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
         throw runtime_error("数据库查询失败: " + string(sqlite3_errmsg(db_.getHandle())));
     }
-
     while(sqlite3_step(stmt) == SQLITE_ROW) {
-        int id = sqlite3_column_int(stmt, 0);
-        const char* type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        const char* config = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        string key = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        int deviceId = sqlite3_column_int(stmt, 1);
+        string type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        string config = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+        bindings.emplace(move(key), ConfigBinding{deviceId, move(type), move(config)});
+    }
+    sqlite3_finalize(stmt);
+    return bindings;
+}
+
+// 迁移状态：空表示尚未决定，pending表示待执行，done表示已完成
+string DeviceManager::loadMigrationState(const string& name) {
+    const char* sql = "SELECT state FROM schema_migrations WHERE name = ?;";
+    sqlite3_stmt* stmt;
+
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("数据库查询失败: " + string(sqlite3_errmsg(db_.getHandle())));
+    }
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    string state;
+    if(sqlite3_step(stmt) == SQLITE_ROW) {
+        state = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return state;
+}
+
+void DeviceManager::saveMigrationState(sqlite3* handle, const string& name, const string& state) {
+    const char* sql = "INSERT OR REPLACE INTO schema_migrations (name, state) VALUES (?, ?);";
+    sqlite3_stmt* stmt;
+
+    if(sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+    sqlite3_bind_text(stmt, 1, name.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, state.c_str(), -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+}
+
+// 首次以带配置绑定的版本打开数据库时决定是否需要认领旧设备：
+// 已有设备但没有任何绑定的是升级前的数据库，标记为待认领，由下一次配置加载执行；
+// 其余（新建的数据库、已有绑定的数据库）直接标记完成，之后通过addDevice添加的设备永远不会被认领
+void DeviceManager::prepareConfigAdoption() {
+    if(!loadMigrationState(CONFIG_ADOPTION_MIGRATION).empty()) return;
+
+    bool hasDevices;
+    {
+        lock_guard<mutex> lock(devicesMutex_);
+        hasDevices = !devices_.empty();
+    }
+    bool legacy = hasDevices && loadConfigBindings().empty();
+    saveMigrationState(db_.getHandle(), CONFIG_ADOPTION_MIGRATION, legacy ? "pending" : "done");
+}
+
+// 升级前的数据库只有设备记录而没有配置绑定：按文件顺序把条目绑定到同类型中ID最小的未绑定设备，
+// 绑定的配置取条目当前配置，从而保留设备状态而不是重复创建；返回新建绑定的键
+vector<string> DeviceManager::adoptLegacyDevices(const vector<ConfigEntry>& entries,
+                                                 unordered_map<string, ConfigBinding>& bindings) {
+    unordered_map<string, deque<int>> candidates;
+    {
+        lock_guard<mutex> lock(devicesMutex_);
+        for(const auto& [id, device] : devices_) {
+            candidates[device->getType()].push_back(id);
+        }
+    }
+    for(auto& [type, ids] : candidates) {
+        sort(ids.begin(), ids.end());
+    }
+
+    vector<string> adopted;
+    for(const auto& entry : entries) {
+        auto it = candidates.find(entry.type);
+        if(it == candidates.end() || it->second.empty() || bindings.count(entry.key)) continue;
+        bindings.emplace(entry.key, ConfigBinding{it->second.front(), entry.type, entry.config});
+        it->second.pop_front();
+        adopted.push_back(entry.key);
+    }
+    return adopted;
+}
+
+void DeviceManager::saveConfigBinding(sqlite3* handle, const string& key, int deviceId,
+                                      const string& type, const string& config) {
+    const char* sql =
+        "INSERT OR REPLACE INTO device_config (config_key, device_id, device_type, config) "
+        "VALUES (?, ?, ?, ?);";
+    sqlite3_stmt* stmt;
+
+    if(sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, deviceId);
+    sqlite3_bind_text(stmt, 3, type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, config.c_str(), -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+}
 
-        if(factories_.find(type) != factories_.end()) {
-            auto device = factories_[type]->createDevice(id, config);
+void DeviceManager::deleteConfigBinding(sqlite3* handle, const string& key) {
+    const char* sql = "DELETE FROM device_config WHERE config_key = ?;";
+    sqlite3_stmt* stmt;
+
+    if(sqlite3_prepare_v2(handle, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle)));
+    }
+}
+
+bool DeviceManager::reloadConfigurations(const string& path) {
+    lock_guard<mutex> reloadLock(reloadMutex_);
+
+    // 解析和差异计算都在设备锁之外进行，不阻塞命令路径
+    vector<ConfigEntry> entries;
+    unordered_map<string, ConfigBinding> bindings;
+    bool adopting = false;
+    try {
+        entries = parseConfigurations(path);
+        bindings = loadConfigBindings();
+        adopting = (loadMigrationState(CONFIG_ADOPTION_MIGRATION) == "pending");
+    } catch(const exception& e) {
+        cerr << "配置加载失败: " << e.what() << endl;
+        return false;
+    }
+    vector<string> adopted;
+    if(adopting) {
+        adopted = adoptLegacyDevices(entries, bindings);
+    }
+
+    unordered_set<int> existing;
+    {
+        lock_guard<mutex> lock(devicesMutex_);
+        for(const auto& [key, binding] : bindings) {
+            if(devices_.count(binding.deviceId)) existing.insert(binding.deviceId);
+        }
+    }
+
+    struct PlannedDevice {
+        string key;
+        string type;
+        string config;
+        DevicePtr device;
+    };
+    vector<PlannedDevice> upserts;      // 新增或配置变更（变更时沿用原设备ID）
+    vector<pair<string, int>> removals; // 键 -> 设备ID（-1表示只删除绑定）
+    unordered_set<string> seen;
+
+    for(auto& entry : entries) {
+        if(!seen.insert(entry.key).second) {
+            cerr << "配置中存在重复的设备键: " << entry.key << endl;
+            continue;
+        }
+        DeviceFactory* factory = findFactory(entry.type);
+        if(!factory) {
+            cerr << "未知设备类型: " << entry.type << endl;
+            continue;
+        }
+
+        auto it = bindings.find(entry.key);
+        bool bound = (it != bindings.end() && existing.count(it->second.deviceId));
+        if(bound && it->second.type == entry.type && it->second.config == entry.config) {
+            continue;
+        }
+
+        int deviceId;
+        if(bound && it->second.type == entry.type) {
+            deviceId = it->second.deviceId;
+        } else {
+            if(bound) removals.emplace_back("", it->second.deviceId);
+            deviceId = nextDeviceId_++;
+        }
+        upserts.push_back({entry.key, entry.type, entry.config, factory->createDevice(deviceId, entry.config)});
+    }
+    for(const auto& [key, binding] : bindings) {
+        if(!seen.count(key)) {
+            removals.emplace_back(key, existing.count(binding.deviceId) ? binding.deviceId : -1);
+        }
+    }
+
+    if(upserts.empty() && removals.empty() && !adopting) {
+        return true;
+    }
+
+    // 删除和新增的绑定（以及SQLite引擎下的设备记录）在独立连接的一个事务中写入，失败时整体回滚，
+    // 内存中的设备不受影响；共享连接上其他线程的写入不会被卷入该事务。内存数据库无法另开连接，只能逐条提交。
+    // 日志结构存储不参与SQLite事务，按"先删除、再提交绑定、最后插入新设备"的顺序写入：
+    // 任一步中断后，绑定要么指向已不存在的设备、要么配置与文件不一致，下次加载时都会重新计算并修复。
+    // 原地更新的设备记录和绑定在安装新设备的strand任务中写入（见下文）
+    sqlite3* conn = db_.openConnection();
+    sqlite3* handle = conn ? conn : db_.getHandle();
+    bool sqliteEngine = (db_.engine() == StorageEngine::SQLITE);
+    SqliteDeviceStore txStore(handle);
+    DeviceStateStore& store = sqliteEngine ? static_cast<DeviceStateStore&>(txStore) : db_.deviceStore();
+    bool persisted = true;
+    try {
+        if(!sqliteEngine) {
+            for(const auto& removal : removals) {
+                if(removal.second >= 0) store.removeDevice(removal.second);
+            }
+        }
+
+        if(conn) DatabaseManager::executeSQL(handle, "BEGIN IMMEDIATE;");
+        try {
+            for(const auto& [key, deviceId] : removals) {
+                if(deviceId >= 0) {
+                    deleteDeviceRecords(handle, deviceId);
+                    if(sqliteEngine) store.removeDevice(deviceId);
+                }
+                if(!key.empty()) deleteConfigBinding(handle, key);
+            }
+            for(const auto& planned : upserts) {
+                int deviceId = planned.device->getId();
+                if(existing.count(deviceId)) continue;
+                if(sqliteEngine) store.insertDevice(deviceId, planned.type, planned.device->getStatus());
+                saveConfigBinding(handle, planned.key, deviceId, planned.type, planned.config);
+            }
+            for(const auto& key : adopted) {
+                const ConfigBinding& binding = bindings.at(key);
+                saveConfigBinding(handle, key, binding.deviceId, binding.type, binding.config);
+            }
+            if(adopting) saveMigrationState(handle, CONFIG_ADOPTION_MIGRATION, "done");
+            if(conn) DatabaseManager::executeSQL(handle, "COMMIT;");
+        } catch(...) {
+            if(conn) sqlite3_exec(handle, "ROLLBACK;", nullptr, nullptr, nullptr);
+            throw;
+        }
+
+        if(!sqliteEngine) {
+            for(const auto& planned : upserts) {
+                int deviceId = planned.device->getId();
+                if(!existing.count(deviceId)) store.insertDevice(deviceId, planned.type, planned.device->getStatus());
+            }
+        }
+    } catch(const exception& e) {
+        cerr << "配置重载失败: " << e.what() << endl;
+        persisted = false;
+    }
+    if(conn) sqlite3_close(conn);
+    if(!persisted) {
+        return false;
+    }
+
+    // 删除和替换已有设备在其strand上执行，不与该设备进行中的命令并发；被替换的设备在锁外析构
+    for(const auto& [key, deviceId] : removals) {
+        if(deviceId < 0) continue;
+        runOnStrand(deviceId, [this, deviceId = deviceId] {
+            DevicePtr removed;
+            lock_guard<mutex> lock(devicesMutex_);
+            removed = detachDeviceLocked(deviceId);
+            return true;
+        });
+    }
+    // 原地更新时，设备记录、绑定和内存中的设备在同一个strand任务中替换，
+    // 之前排队的命令不会在记录写入后再把旧设备的状态写回；先写记录再写绑定，中断后下次加载会重新应用
+    bool installed = true;
+    for(auto& planned : upserts) {
+        int deviceId = planned.device->getId();
+        auto install = [this, &planned, deviceId] {
+            DevicePtr replaced;
+            lock_guard<mutex> lock(devicesMutex_);
+            indexDevice(*planned.device);
+            auto& slot = devices_[deviceId];
+            replaced = move(slot);
+            slot = move(planned.device);
+            recordChange(deviceId);
+            return true;
+        };
+        if(!existing.count(deviceId)) {
+            install();
+            continue;
+        }
+        installed = runOnStrand(deviceId, [this, &planned, deviceId, &install] {
+            try {
+                db_.deviceStore().updateDevice(deviceId, planned.type, planned.device->getStatus());
+                saveConfigBinding(db_.getHandle(), planned.key, deviceId, planned.type, planned.config);
+            } catch(const exception& e) {
+                cerr << "设备配置更新失败: " << deviceId << ": " << e.what() << endl;
+                return false;
+            }
+            return install();
+        }) && installed;
+    }
+    return installed;
+}
+
+bool DeviceManager::startConfigWatch(const string& path) {
+#ifdef __linux__
+    if(watching_) return false;
+
+    // 监听所在目录，编辑器通常以"写临时文件再重命名"的方式保存
+    filesystem::path file(path);
+    string dir = file.has_parent_path() ? file.parent_path().string() : ".";
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0) {
+        cerr << "配置监听初始化失败: " << strerror(errno) << endl;
+        return false;
+    }
+    if(inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        cerr << "配置监听失败: " << dir << ": " << strerror(errno) << endl;
+        close(fd);
+        return false;
+    }
+
+    watching_ = true;
+    watchThread_ = thread(&DeviceManager::watchLoop, this, fd, file.filename().string(), path);
+    return true;
+#else
+    cerr << "当前平台不支持配置监听，请调用reloadConfigurations" << endl;
+    return false;
+#endif
+}
+
+void DeviceManager::stopConfigWatch() {
+    watching_ = false;
+    if(watchThread_.joinable()) {
+        watchThread_.join();
+    }
+}
+
+void DeviceManager::watchLoop(int inotifyFd, string fileName, string path) {
+#ifdef __linux__
+    // 连续写入合并为一次重载
+    constexpr auto DEBOUNCE = chrono::milliseconds(200);
+    bool changed = false;
+    auto lastEvent = chrono::steady_clock::now();
+    alignas(inotify_event) char buffer[4096];
+
+    while(watching_) {
+        pollfd pfd{inotifyFd, POLLIN, 0};
+        if(poll(&pfd, 1, 100) > 0) {
+            ssize_t len;
+            while((len = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+                for(char* p = buffer; p < buffer + len; ) {
+                    auto* event = reinterpret_cast<inotify_event*>(p);
+                    if(event->len > 0 && fileName == event->name) {
+                        changed = true;
+                        lastEvent = chrono::steady_clock::now();
+                    }
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+        }
+
+        if(changed && chrono::steady_clock::now() - lastEvent >= DEBOUNCE) {
+            changed = false;
+            reloadConfigurations(path);
+        }
+    }
+    close(inotifyFd);
+#else
+    (void)inotifyFd;
+    (void)fileName;
+    (void)path;
+#endif
+}
+
+void DeviceManager::loadDevices() {
+    lock_guard<mutex> lock(devicesMutex_);
+
+    index_.clear();
+
+    // 批量加载时同类型设备连续出现，缓存上一次解析的工厂避免重复哈希
+    string lastType;
+    DeviceFactory* factory = nullptr;
+
+    db_.deviceStore().loadDevices([&](int id, const string& type, const string& config) {
+        if(lastType != type) {
+            lastType = type;
+            factory = findFactory(lastType);
+        }
+
+        if(factory) {
+            auto device = factory->createDevice(id, config);
             if(device) {
+                indexDevice(*device);
                 devices_[id] = move(device);
-                nextDeviceId_ = max(nextDeviceId_, id + 1);
+                nextDeviceId_ = max(nextDeviceId_.load(), id + 1);
             }
         }
+    });
+
+    loadDeviceGroups();
+
+    // 重新加载后旧版本号不再可信，强制所有客户端走全量快照
+    resetChangeLog();
+}
+
+void DeviceManager::loadDeviceGroups() {
+    const char* sql = "SELECT device_id, group_name FROM device_groups;";
+    sqlite3_stmt* stmt;
+
+    // 分组只影响查询，读取失败不阻止设备加载
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "设备分组加载失败: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return;
+    }
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        int deviceId = sqlite3_column_int(stmt, 0);
+        if(devices_.count(deviceId)) {
+            index_.setGroup(deviceId, reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1)));
+        }
     }
     sqlite3_finalize(stmt);
 }
 
+// 删除设备的附属记录：设备ID在重启后可能被复用，残留的授权会被新设备继承
+void DeviceManager::deleteDeviceRecords(sqlite3* handle, int deviceId) {
+    DatabaseManager::executeSQL(handle, "DELETE FROM device_groups WHERE device_id = " + to_string(deviceId));
+    DatabaseManager::executeSQL(handle, "DELETE FROM permissions WHERE device_id = " + to_string(deviceId));
+}
+
 bool DeviceManager::addDevice(const string& type, const string& config) {
+    int deviceId;
+    return addDevice(type, config, deviceId);
+}
+
+// 控制命令在调用完成后录制，携带真实结果、会话键和鉴权得到的用户名
+static void traceCommand(bool success, const string& sessionId, int deviceId,
+                         const string& username, const string& command) {
+    auto& tracer = TraceRecorder::getInstance();
+    if(tracer.isEnabled()) {
+        tracer.record(TraceRecorder::TraceOp::SET_DEVICE_STATUS, success,
+                      sessionId.empty() ? 0 : TraceRecorder::sessionKey(sessionId), deviceId, username, command);
+    }
+}
+
+bool DeviceManager::addDevice(const string& type, const string& config, int& deviceId) {
+    bool success = insertNewDevice(type, config, deviceId);
+
+    auto& tracer = TraceRecorder::getInstance();
+    if(tracer.isEnabled()) {
+        tracer.record(TraceRecorder::TraceOp::ADD_DEVICE, success, 0, success ? deviceId : -1, type, config);
+    }
+    return success;
+}
+
+void DeviceManager::traceDeviceSnapshot() {
+    auto& tracer = TraceRecorder::getInstance();
+    if(!tracer.isEnabled()) return;
+
+    lock_guard<mutex> lock(devicesMutex_);
+    for(const auto& [id, device] : devices_) {
+        lock_guard<mutex> stateLock(deviceLock(id));
+        tracer.record(TraceRecorder::TraceOp::DEVICE_SNAPSHOT, true, 0, id, device->getType(), device->getStatus());
+    }
+}
+
+bool DeviceManager::insertNewDevice(const string& type, const string& config, int& deviceId) {
     lock_guard<mutex> lock(devicesMutex_);
     
-    if(factories_.find(type) == factories_.end()) {
+    DeviceFactory* factory = findFactory(type);
+    if(!factory) {
         cerr << "未知设备类型: " << type << endl;
         return false;
     }
 
     int newId = nextDeviceId_++;
-    auto device = factories_[type]->createDevice(newId, config);
+    auto device = factory->createDevice(newId, config);
     if(!device) return false;
 
-    // 插入数据库
-    stringstream sql;
-    sql << "INSERT INTO devices (id, device_type, status) VALUES ("
-        << newId << ", '" << type << "', '" << device->getStatus() << "');";
-    
+    // 写入设备存储
     try {
-        db_.executeSQL(sql.str());
+        db_.deviceStore().insertDevice(newId, type, device->getStatus());
+        indexDevice(*device);
         devices_.emplace(newId, move(device));
+        recordChange(newId);
+        deviceId = newId;
         return true;
     } catch(const exception& e) {
         cerr << "设备添加失败: " << e.what() << endl;
@@ -201,18 +745,22 @@ bool DeviceManager::addDevice(const string& type, const string& config) {
 }
 
 bool DeviceManager::removeDevice(int deviceId) {
+    return runOnStrand(deviceId, [this, deviceId] { return eraseDevice(deviceId); });
+}
+
+bool DeviceManager::eraseDevice(int deviceId) {
+    DevicePtr removed;
     lock_guard<mutex> lock(devicesMutex_);
     
     if(devices_.find(deviceId) == devices_.end()) {
+        releaseStrand(deviceId);
         return false;
     }
 
-    stringstream sql;
-    sql << "DELETE FROM devices WHERE id = " << deviceId;
-    
     try {
-        db_.executeSQL(sql.str());
-        devices_.erase(deviceId);
+        deleteDeviceRecords(db_.getHandle(), deviceId);
+        db_.deviceStore().removeDevice(deviceId);
+        removed = detachDeviceLocked(deviceId);
         return true;
     } catch(const exception& e) {
         cerr << "设备删除失败: " << e.what() << endl;
@@ -220,13 +768,43 @@ bool DeviceManager::removeDevice(int deviceId) {
     }
 }
 
+// 从内存中摘除设备及其索引、strand和限流状态（调用方需持有devicesMutex_）
+DevicePtr DeviceManager::detachDeviceLocked(int deviceId) {
+    auto it = devices_.find(deviceId);
+    if(it == devices_.end()) return nullptr;
+
+    DevicePtr device = move(it->second);
+    devices_.erase(it);
+    index_.remove(deviceId);
+    if(executor_) executor_->removeStrand(deviceId);
+    if(admission_) admission_->removeDevice(deviceId);
+    recordChange(deviceId, true);
+    return device;
+}
+
 bool DeviceManager::setDeviceStatus(int deviceId, const string& command) {
+    bool success = runOnStrand(deviceId, [&] { return applyDeviceStatus(deviceId, command); });
+    traceCommand(success, "", deviceId, "", command);
+    return success;
+}
+
+// 在设备的strand上执行（启用并行执行时）
+bool DeviceManager::applyDeviceStatus(int deviceId, const string& command) {
     auto* device = getDevice(deviceId);
-    if(!device) return false;
+    if(!device) {
+        releaseStrand(deviceId);
+        return false;
+    }
 
     try {
-        device->control(command);
+        {
+            // strand保证只有一个写者，状态锁只用于与strand之外的读取互斥
+            lock_guard<mutex> stateLock(deviceLock(deviceId));
+            device->control(command);
+        }
         device->updateDatabase(db_);
+        indexDevice(*device);
+        recordChange(deviceId);
         return true;
     } catch(const exception& e) {
         cerr << "设备控制失败: " << e.what() << endl;
@@ -234,9 +812,99 @@ bool DeviceManager::setDeviceStatus(int deviceId, const string& command) {
     }
 }
 
+// 无效ID（或已删除）的命令不会为其保留strand：任务在strand上发现设备不存在时标记回收
+void DeviceManager::releaseStrand(int deviceId) {
+    if(executor_) executor_->removeStrand(deviceId);
+}
+
 string DeviceManager::getDeviceStatus(int deviceId) {
-    auto* device = getDevice(deviceId);
-    return device ? device->getStatus() : "";
+    // 在状态锁下读取，不经过strand，也不会为无效ID创建strand
+    lock_guard<mutex> lock(devicesMutex_);
+    auto it = devices_.find(deviceId);
+    if(it == devices_.end()) return "";
+    lock_guard<mutex> stateLock(deviceLock(deviceId));
+    return it->second->getStatus();
+}
+
+//--------------------- 并行执行 ---------------------
+void DeviceManager::enableParallelExecution(size_t threadCount) {
+    if(!executor_) {
+        executor_ = make_unique<StrandExecutor>(threadCount);
+    }
+}
+
+future<bool> DeviceManager::submitDeviceStatus(int deviceId, const string& command) {
+    if(!admitCommand(deviceId)) {
+        traceCommand(false, "", deviceId, "", command);
+        promise<bool> result;
+        result.set_value(false);
+        return result.get_future();
+    }
+    return dispatchDeviceStatus(deviceId, command);
+}
+
+// 已通过准入检查的异步提交（submitDeviceStatus和命令合并阶段共用）
+future<bool> DeviceManager::dispatchDeviceStatus(int deviceId, const string& command) {
+    if(!executor_) {
+        promise<bool> result;
+        result.set_value(setDeviceStatus(deviceId, command));
+        return result.get_future();
+    }
+
+    return executor_->submit(deviceId, [this, deviceId, command] {
+        bool success = applyDeviceStatus(deviceId, command);
+        traceCommand(success, "", deviceId, "", command);
+        return success;
+    });
+}
+
+bool DeviceManager::admitCommand(int deviceId) {
+    return admit("", deviceId);
+}
+
+bool DeviceManager::admit(const string& username, int deviceId) {
+    if(!admission_) return true;
+    return getDeviceTypeId(deviceId) != INVALID_DEVICE_TYPE && admission_->admit(username, deviceId);
+}
+
+//--------------------- 会话鉴权 ---------------------
+bool DeviceManager::authorize(const string& sessionId, int deviceId, DeviceOperation op) const {
+    string username;
+    return authorize(sessionId, deviceId, op, username);
+}
+
+bool DeviceManager::authorize(const string& sessionId, int deviceId, DeviceOperation op, string& username) const {
+    if(!users_) return false;
+    auto permissions = users_->getSessionPermissions(sessionId, username);
+    return permissions && permissions->allows(deviceId, op);
+}
+
+bool DeviceManager::setDeviceStatus(const string& sessionId, int deviceId, const string& command) {
+    string username;
+    bool success = false;
+    if(!authorize(sessionId, deviceId, DeviceOperation::CONTROL, username)) {
+        cerr << "无权控制设备: " << username << " -> " << deviceId << endl;
+    } else if(admit(username, deviceId)) {
+        success = runOnStrand(deviceId, [&] { return applyDeviceStatus(deviceId, command); });
+    }
+    traceCommand(success, sessionId, deviceId, username, command);
+    return success;
+}
+
+string DeviceManager::getDeviceStatus(const string& sessionId, int deviceId) {
+    if(!authorize(sessionId, deviceId, DeviceOperation::READ)) {
+        return "";
+    }
+    return getDeviceStatus(deviceId);
+}
+
+bool DeviceManager::removeDevice(const string& sessionId, int deviceId) {
+    string username;
+    if(!authorize(sessionId, deviceId, DeviceOperation::MANAGE, username)) {
+        cerr << "无权删除设备: " << username << " -> " << deviceId << endl;
+        return false;
+    }
+    return removeDevice(deviceId);
 }
 
 Device* DeviceManager::getDevice(int deviceId) {
@@ -252,4 +920,181 @@ vector<Device*> DeviceManager::getAllDevices() {
         devices.push_back(device.get());
     }
     return devices;
+}
+
+vector<Device*> DeviceManager::getDevicesByType(const string& type) {
+    vector<Device*> devices;
+    DeviceTypeId typeId = resolveType(type);
+    if(typeId == INVALID_DEVICE_TYPE) return devices;
+
+    lock_guard<mutex> lock(devicesMutex_);
+    for(auto& [id, device] : devices_) {
+        if(device->getTypeId() == typeId) {
+            devices.push_back(device.get());
+        }
+    }
+    return devices;
+}
+
+//--------------------- 二级索引 ---------------------
+void DeviceManager::indexDevice(const Device& device) {
+    DeviceIndexFields fields;
+    device.getIndexFields(fields);
+    index_.update(device.getId(), device.getTypeId(), fields);
+}
+
+vector<Device*> DeviceManager::queryDevices(const DeviceQuery& query) {
+    vector<Device*> devices;
+    DeviceTypeId typeId = INVALID_DEVICE_TYPE;
+    if(!query.type.empty()) {
+        typeId = resolveType(query.type);
+        if(typeId == INVALID_DEVICE_TYPE) return devices;
+    }
+
+    vector<int> ids = index_.query(query, typeId);
+    devices.reserve(ids.size());
+
+    lock_guard<mutex> lock(devicesMutex_);
+    for(int id : ids) {
+        auto it = devices_.find(id);
+        if(it != devices_.end()) {
+            devices.push_back(it->second.get());
+        }
+    }
+    return devices;
+}
+
+bool DeviceManager::setDeviceGroup(int deviceId, const string& group) {
+    lock_guard<mutex> lock(devicesMutex_);
+    if(devices_.find(deviceId) == devices_.end()) {
+        return false;
+    }
+
+    sqlite3_stmt* stmt;
+    const char* sql = group.empty()
+        ? "DELETE FROM device_groups WHERE device_id = ?;"
+        : "INSERT OR REPLACE INTO device_groups (device_id, group_name) VALUES (?, ?);";
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "数据库错误: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, deviceId);
+    if(!group.empty()) {
+        sqlite3_bind_text(stmt, 2, group.c_str(), -1, SQLITE_STATIC);
+    }
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    if(!success) {
+        cerr << "设备分组保存失败: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return false;
+    }
+    return index_.setGroup(deviceId, group);
+}
+
+//--------------------- 增量同步 ---------------------
+void DeviceManager::recordChange(int deviceId, bool removed) {
+    lock_guard<mutex> lock(changeMutex_);
+    changeLog_.push_back({++version_, deviceId, removed});
+    while(changeLog_.size() > changeLogCapacity_) {
+        changeLog_.pop_front();
+    }
+}
+
+void DeviceManager::resetChangeLog() {
+    // 版本号只在本次运行内有效，每次重置生成新纪元，旧纪元的客户端一律走全量快照
+    random_device rd;
+    uint64_t epoch;
+    do {
+        epoch = (static_cast<uint64_t>(rd()) << 32) | rd();
+    } while(epoch == 0);
+
+    lock_guard<mutex> lock(changeMutex_);
+    changeLog_.clear();
+    epoch_ = epoch;
+    ++version_;
+}
+
+void DeviceManager::setChangeLogCapacity(size_t capacity) {
+    lock_guard<mutex> lock(changeMutex_);
+    changeLogCapacity_ = capacity;
+    while(changeLog_.size() > changeLogCapacity_) {
+        changeLog_.pop_front();
+    }
+}
+
+uint64_t DeviceManager::getCurrentEpoch() {
+    lock_guard<mutex> lock(changeMutex_);
+    return epoch_;
+}
+
+uint64_t DeviceManager::getCurrentVersion() {
+    lock_guard<mutex> lock(changeMutex_);
+    return version_;
+}
+
+DeviceChangeSet DeviceManager::getChangesSince(uint64_t epoch, uint64_t version) {
+    DeviceChangeSet result;
+    vector<ChangeRecord> latest;
+    {
+        lock_guard<mutex> lock(changeMutex_);
+        result.epoch = epoch_;
+        result.version = version_;
+        if(epoch == epoch_ && version == version_) {
+            return result;
+        }
+
+        // 版本来自其他纪元或超前于服务端，或所需的变更已被淘汰出日志，退化为全量快照
+        if(epoch != epoch_ || version > version_ ||
+           changeLog_.empty() || version + 1 < changeLog_.front().version) {
+            result.snapshot = true;
+        } else {
+            // 版本号连续，可直接定位起点；倒序遍历，每个设备只保留最新记录
+            size_t start = version + 1 - changeLog_.front().version;
+            unordered_set<int> seen;
+            for(size_t i = changeLog_.size(); i > start; --i) {
+                const ChangeRecord& record = changeLog_[i - 1];
+                if(seen.insert(record.deviceId).second) {
+                    latest.push_back(record);
+                }
+            }
+        }
+    }
+
+    if(result.snapshot) {
+        return buildSnapshot();
+    }
+
+    // 按版本升序返回，状态读取当前值（至少一次语义，不会漏掉更新）
+    reverse(latest.begin(), latest.end());
+    lock_guard<mutex> lock(devicesMutex_);
+    for(const auto& record : latest) {
+        auto it = devices_.find(record.deviceId);
+        if(record.removed || it == devices_.end()) {
+            result.changes.push_back({record.version, record.deviceId, true, "", ""});
+        } else {
+            lock_guard<mutex> stateLock(deviceLock(record.deviceId));
+            result.changes.push_back({record.version, record.deviceId, false,
+                                      it->second->getType(), it->second->getStatus()});
+        }
+    }
+    return result;
+}
+
+DeviceChangeSet DeviceManager::buildSnapshot() {
+    DeviceChangeSet result;
+    lock_guard<mutex> lock(devicesMutex_);
+    {
+        // 先取版本号再读状态，保证快照不早于返回的版本
+        lock_guard<mutex> changeLock(changeMutex_);
+        result.epoch = epoch_;
+        result.version = version_;
+    }
+    result.snapshot = true;
+    result.changes.reserve(devices_.size());
+    for(auto& [id, device] : devices_) {
+        lock_guard<mutex> stateLock(deviceLock(id));
+        result.changes.push_back({result.version, id, false, device->getType(), device->getStatus()});
+    }
+    return result;
 }
\ No newline at end of file
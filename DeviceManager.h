@@ -2,63 +2,330 @@
 #define DEVICE_MANAGER_H
 
 #include "DatabaseManager/DatabaseManager.h"
+#include "DeviceManager/DeviceIndex.h"
+#include "DeviceManager/StrandExecutor.h"
+#include "UserManager/UserManager.h"
+#include "AdmissionController/AdmissionController.h"
 #include <memory>
+#include <array>
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <mutex>
 #include <atomic>
+#include <thread>
+#include <string>
+#include <cstdint>
+#include <new>
+
+constexpr DeviceTypeId INVALID_DEVICE_TYPE = 0xFFFF;
 
 // 设备接口
 class Device {
 public:
     virtual ~Device() = default;
-    virtual std::string getType() const = 0;
+    virtual const std::string& getType() const = 0;
+    virtual DeviceTypeId getTypeId() const = 0;
     virtual std::string getStatus() const = 0;
     virtual void control(const std::string& command) = 0;
     virtual void updateDatabase(DatabaseManager& db) = 0;
     virtual int getId() const = 0;
+    // 上报可索引字段，供DeviceIndex增量维护
+    virtual void getIndexFields(DeviceIndexFields& /*fields*/) const {}
+    // 字段是否幂等（可按后写者胜合并），相对调节类字段应返回false；
+    // 按类型静态定义，具体类型可隐藏此默认实现，注册时按TYPE_ID登记，查询无需访问设备对象
+    static bool isMergeableField(const std::string& /*field*/) { return true; }
 };
 
+using MergeRule = bool (*)(const std::string& field);
+
+class DeviceFactory;
+
+// 设备由所属工厂的对象池回收，而不是直接delete
+struct DeviceDeleter {
+    DeviceFactory* factory = nullptr;
+    void operator()(Device* device) const;
+};
+
+using DevicePtr = std::unique_ptr<Device, DeviceDeleter>;
+
 // 设备工厂接口
 class DeviceFactory {
 public:
-    virtual std::unique_ptr<Device> createDevice(int id, const std::string& config) = 0;
+    virtual DevicePtr createDevice(int id, const std::string& config) = 0;
+    virtual void destroyDevice(Device* device) = 0;
     virtual ~DeviceFactory() = default;
 };
 
+inline void DeviceDeleter::operator()(Device* device) const {
+    if(factory) {
+        factory->destroyDevice(device);
+    } else {
+        delete device;
+    }
+}
+
+// 设备对象池：按类型分块(slab)分配，释放的槽位进入空闲链表复用
+template<typename T, size_t SlabSize = 256>
+class DevicePool {
+public:
+    DevicePool() = default;
+    DevicePool(const DevicePool&) = delete;
+    DevicePool& operator=(const DevicePool&) = delete;
+
+    template<typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot = acquire();
+        try {
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        } catch(...) {
+            release(slot);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        release(reinterpret_cast<Slot*>(object));
+    }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> slabs_;
+    Slot* freeList_ = nullptr;
+    std::mutex mutex_;
+
+    Slot* acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!freeList_) {
+            slabs_.push_back(std::make_unique<Slot[]>(SlabSize));
+            Slot* slab = slabs_.back().get();
+            for(size_t i = 0; i < SlabSize; ++i) {
+                slab[i].next = freeList_;
+                freeList_ = &slab[i];
+            }
+        }
+        Slot* slot = freeList_;
+        freeList_ = slot->next;
+        return slot;
+    }
+
+    void release(Slot* slot) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->next = freeList_;
+        freeList_ = slot;
+    }
+};
+
+// 设备变更记录，版本号单调递增
+struct DeviceChange {
+    uint64_t version;
+    int deviceId;
+    bool removed;
+    std::string type;
+    std::string status;
+};
+
+// 增量同步结果
+struct DeviceChangeSet {
+    uint64_t epoch = 0;       // 版本号所属纪元，服务重启或重新加载后改变
+    uint64_t version = 0;     // 服务端当前版本，客户端下次以 epoch + version 调用getChangesSince
+    bool snapshot = false;    // 客户端落后超出变更日志范围时返回全量快照
+    std::vector<DeviceChange> changes;
+};
+
+// 编译期设备类型列表，内置类型在此声明后由DeviceManager统一注册
+template<typename... Ts>
+struct DeviceTypeList {
+    // 各类型的TYPE_ID必须等于其在列表中的下标，工厂表按此下标索引
+    static constexpr bool idsMatchPositions() {
+        size_t position = 0;
+        return ((Ts::TYPE_ID == position++) && ...);
+    }
+};
+
 // 设备管理器
 class DeviceManager {
 public:
     DeviceManager(DatabaseManager& db, const std::string& configPath);
+    ~DeviceManager();
     
     void loadDevices();
     bool addDevice(const std::string& type, const std::string& config);
+    bool addDevice(const std::string& type, const std::string& config, int& deviceId);
+    // 把当前所有设备（ID、类型、状态）写入trace，回放时据此重建录制开始前已存在的设备；
+    // 构造时若已在录制会自动调用，构造之后才开始录制时应手动调用
+    void traceDeviceSnapshot();
     bool removeDevice(int deviceId);
+    // 返回的指针只用于读取不可变属性（ID、类型）；状态的读写应通过getDeviceStatus/setDeviceStatus
     Device* getDevice(int deviceId);
     std::vector<Device*> getAllDevices();
+    std::vector<Device*> getDevicesByType(const std::string& type);
+
+    // 基于二级索引的设备查询；分组（房间）标签持久化在device_groups表，空字符串表示移出分组
+    std::vector<Device*> queryDevices(const DeviceQuery& query);
+    bool setDeviceGroup(int deviceId, const std::string& group);
     
-    // 设备控制接口
+    // 设备控制接口（系统内部调用，不经过准入控制）
     bool setDeviceStatus(int deviceId, const std::string& command);
     std::string getDeviceStatus(int deviceId);
 
+    // 带会话鉴权的接口：每次按会话ID从UserManager取当前权限位图（登录时已编译），
+    // 注销、过期和授权变更立即生效；未设置UserManager时一律拒绝
+    bool setDeviceStatus(const std::string& sessionId, int deviceId, const std::string& command);
+    std::string getDeviceStatus(const std::string& sessionId, int deviceId);
+    bool removeDevice(const std::string& sessionId, int deviceId);
+    bool authorize(const std::string& sessionId, int deviceId, DeviceOperation op) const;
+
+    // 设置会话来源（不转移所有权）
+    void setUserManager(UserManager* users) { users_ = users; }
+
+    // 设置准入控制器后，带会话的控制命令和submitDeviceStatus先经过限流检查，
+    // 命令合并阶段按合并后的批次检查（不转移所有权）
+    void setAdmissionController(AdmissionController* controller) { admission_ = controller; }
+    // 无会话命令的准入检查，只检查设备限流；未设置准入控制器时总是通过，设备不存在时拒绝
+    bool admitCommand(int deviceId);
+
+    // 并行命令执行：同一设备的命令串行有序，不同设备在所有核心上并行
+    // 启用后同步的控制和删除接口也在设备的strand上执行，删除不会与进行中的命令并发；
+    // 状态读取（getDeviceStatus、增量同步和快照）在设备状态锁下进行，与strand上的control()互斥
+    void enableParallelExecution(size_t threadCount = 0);
+    std::future<bool> submitDeviceStatus(int deviceId, const std::string& command);
+
+    DeviceTypeId resolveType(const std::string& type) const;
+    // 设备当前的类型ID，设备不存在时返回INVALID_DEVICE_TYPE
+    DeviceTypeId getDeviceTypeId(int deviceId);
+    bool isMergeableField(DeviceTypeId typeId, const std::string& field) const;
+
+    // 增量同步接口：只返回指定版本之后修改过的设备（每个设备仅保留最新一次）
+    // 纪元不一致（服务重启过）或版本超前时返回全量快照；新客户端传入 0, 0
+    DeviceChangeSet getChangesSince(uint64_t epoch, uint64_t version);
+    uint64_t getCurrentEpoch();
+    uint64_t getCurrentVersion();
+    void setChangeLogCapacity(size_t capacity);
+
+    // 配置热加载：按稳定设备键与当前设备做差异，只应用新增、删除和配置变更
+    bool reloadConfigurations(const std::string& path);
+    bool startConfigWatch(const std::string& path);
+    void stopConfigWatch();
+
 private:
+    // 命令合并阶段自行做准入检查，通过dispatchDeviceStatus提交合并后的批次
+    friend class CommandCoalescer;
+
     DatabaseManager& db_;
-    std::unordered_map<int, std::unique_ptr<Device>> devices_;
-    std::unordered_map<std::string, std::unique_ptr<DeviceFactory>> factories_;
+    // 工厂需比设备后析构，设备析构时要把内存归还到工厂的对象池
+    std::vector<std::unique_ptr<DeviceFactory>> factories_;
+    std::vector<MergeRule> mergeRules_;
+    std::unordered_map<std::string, DeviceTypeId> typeIds_;
+    std::unordered_map<int, DevicePtr> devices_;
     std::mutex devicesMutex_;
+    // 设备状态锁（按设备ID分片）：strand上执行control()时持有，在strand之外读取状态（增量同步、快照）时持有。
+    // 加锁顺序：devicesMutex_ -> 状态锁
+    static constexpr size_t DEVICE_LOCK_STRIPES = 64;
+    std::array<std::mutex, DEVICE_LOCK_STRIPES> deviceLocks_;
+    std::mutex& deviceLock(int deviceId) { return deviceLocks_[static_cast<unsigned>(deviceId) % DEVICE_LOCK_STRIPES]; }
     std::atomic<int> nextDeviceId_{1};
+    DeviceIndex index_;
+    AdmissionController* admission_ = nullptr;
+    UserManager* users_ = nullptr;
+
+    // 有界变更日志，加锁顺序：devicesMutex_ -> changeMutex_
+    struct ChangeRecord {
+        uint64_t version;
+        int deviceId;
+        bool removed;
+    };
+    std::deque<ChangeRecord> changeLog_;
+    size_t changeLogCapacity_ = 65536;
+    uint64_t epoch_ = 0;
+    uint64_t version_ = 0;
+    std::mutex changeMutex_;
     
-    void registerFactory(const std::string& type, std::unique_ptr<DeviceFactory> factory);
-    void loadConfigurations(const std::string& path);
+    bool insertNewDevice(const std::string& type, const std::string& config, int& deviceId);
+    bool applyDeviceStatus(int deviceId, const std::string& command);
+    void releaseStrand(int deviceId);
+    std::future<bool> dispatchDeviceStatus(int deviceId, const std::string& command);
+    bool eraseDevice(int deviceId);
+    DevicePtr detachDeviceLocked(int deviceId);
+    bool authorize(const std::string& sessionId, int deviceId, DeviceOperation op, std::string& username) const;
+    // 先确认设备存在再限流，无效设备ID不会在准入控制器中创建令牌桶
+    bool admit(const std::string& username, int deviceId);
+    void indexDevice(const Device& device);
+    void loadDeviceGroups();
+    void deleteDeviceRecords(sqlite3* handle, int deviceId);
+    void recordChange(int deviceId, bool removed = false);
+    void resetChangeLog();
+    DeviceChangeSet buildSnapshot();
+
+    // 最后声明，最先析构：执行器退出前仍可访问上面的成员
+    std::unique_ptr<StrandExecutor> executor_;
+
+    // 在设备的strand上同步执行（未启用并行执行时直接执行），不能在strand任务内调用
+    template<typename F>
+    auto runOnStrand(int deviceId, F&& task) -> decltype(task());
+
+    template<typename... Ts>
+    void registerFactories(DeviceTypeList<Ts...>);
+    void registerFactory(const std::string& type, DeviceTypeId typeId, std::unique_ptr<DeviceFactory> factory,
+                         MergeRule mergeRule);
+    DeviceFactory* findFactory(const std::string& type) const;
+
+    // 配置文件条目及其持久化绑定
+    struct ConfigEntry {
+        std::string key;
+        std::string type;
+        std::string config;
+    };
+    struct ConfigBinding {
+        int deviceId;
+        std::string type;
+        std::string config;
+    };
+
+    std::mutex reloadMutex_;
+    std::atomic<bool> watching_{false};
+    std::thread watchThread_;
+
+    std::vector<ConfigEntry> parseConfigurations(const std::string& path);
+    std::unordered_map<std::string, ConfigBinding> loadConfigBindings();
+    std::string loadMigrationState(const std::string& name);
+    static void saveMigrationState(sqlite3* handle, const std::string& name, const std::string& state);
+    void prepareConfigAdoption();
+    std::vector<std::string> adoptLegacyDevices(const std::vector<ConfigEntry>& entries,
+                                                std::unordered_map<std::string, ConfigBinding>& bindings);
+    static void saveConfigBinding(sqlite3* handle, const std::string& key, int deviceId,
+                                  const std::string& type, const std::string& config);
+    static void deleteConfigBinding(sqlite3* handle, const std::string& key);
+    void watchLoop(int inotifyFd, std::string fileName, std::string path);
 };
 
 // 具体设备工厂注册
 template<typename T>
 class DeviceFactoryImpl : public DeviceFactory {
 public:
-    std::unique_ptr<Device> createDevice(int id, const std::string& config) override {
-        return std::make_unique<T>(id, config);
+    DevicePtr createDevice(int id, const std::string& config) override {
+        return DevicePtr(pool_.create(id, config), DeviceDeleter{this});
+    }
+
+    void destroyDevice(Device* device) override {
+        pool_.destroy(static_cast<T*>(device));
     }
+
+private:
+    DevicePool<T> pool_;
 };
 
+template<typename... Ts>
+void DeviceManager::registerFactories(DeviceTypeList<Ts...>) {
+    static_assert(DeviceTypeList<Ts...>::idsMatchPositions(),
+                  "设备类型的TYPE_ID必须等于其在DeviceTypeList中的下标");
+    (registerFactory(Ts::TYPE_NAME, Ts::TYPE_ID, std::make_unique<DeviceFactoryImpl<Ts>>(),
+                     &Ts::isMergeableField), ...);
+}
+
 #endif // DEVICE_MANAGER_H
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef DEVICE_PERMISSIONS_H
+#define DEVICE_PERMISSIONS_H
+
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// 设备操作类型，数据库中以位掩码存储（READ=1, CONTROL=2, MANAGE=4）
+enum class DeviceOperation : uint8_t {
+    READ = 0,
+    CONTROL = 1,
+    MANAGE = 2
+};
+
+constexpr size_t DEVICE_OPERATION_COUNT = 3;
+constexpr uint8_t DEVICE_OPERATION_ALL = (1u << DEVICE_OPERATION_COUNT) - 1;
+
+constexpr uint8_t operationMask(DeviceOperation op) {
+    return static_cast<uint8_t>(1u << static_cast<uint8_t>(op));
+}
+
+// 会话级设备权限：登录时由权限表编译生成，之后只读
+// 每种操作一个按设备ID索引的位图，鉴权为一次位测试
+class DevicePermissions {
+public:
+    void grant(int deviceId, uint8_t operations) {
+        if(deviceId < 0) return;
+        size_t word = static_cast<size_t>(deviceId) / 64;
+        uint64_t mask = uint64_t(1) << (deviceId % 64);
+        for(size_t op = 0; op < DEVICE_OPERATION_COUNT; ++op) {
+            if(operations & (1u << op)) {
+                if(bits_[op].size() <= word) {
+                    bits_[op].resize(word + 1, 0);
+                }
+                bits_[op][word] |= mask;
+            }
+        }
+    }
+
+    void grantAll(uint8_t operations) {
+        allDevices_ |= operations & DEVICE_OPERATION_ALL;
+    }
+
+    bool allows(int deviceId, DeviceOperation op) const {
+        if(allDevices_ & operationMask(op)) return true;
+        if(deviceId < 0) return false;
+
+        const auto& bits = bits_[static_cast<size_t>(op)];
+        size_t word = static_cast<size_t>(deviceId) / 64;
+        return word < bits.size() && (bits[word] >> (deviceId % 64)) & 1;
+    }
+
+    bool allowsAll(DeviceOperation op) const {
+        return allDevices_ & operationMask(op);
+    }
+
+private:
+    uint8_t allDevices_ = 0;
+    std::array<std::vector<uint64_t>, DEVICE_OPERATION_COUNT> bits_;
+};
+
+#endif // DEVICE_PERMISSIONS_H
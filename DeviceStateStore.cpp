@@ -0,0 +1,63 @@
+#include "DatabaseManager/DeviceStateStore.h"
+#include "DatabaseManager/DatabaseManager.h"
+#include <sqlite3.h>
+#include <stdexcept>
+
+using namespace std;
+
+SqliteDeviceStore::SqliteDeviceStore(sqlite3* handle) : handle_(handle) {}
+
+void SqliteDeviceStore::insertDevice(int id, const string& type, const string& status) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO devices (id, device_type, status) VALUES (?, ?, ?);";
+    if(sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle_)));
+    }
+    sqlite3_bind_int(stmt, 1, id);
+    sqlite3_bind_text(stmt, 2, type.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, status.c_str(), -1, SQLITE_STATIC);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle_)));
+    }
+}
+
+void SqliteDeviceStore::updateDevice(int id, const string& /*type*/, const string& status) {
+    sqlite3_stmt* stmt;
+    const char* sql = "UPDATE devices SET status = ?, last_modified = CURRENT_TIMESTAMP WHERE id = ?;";
+    if(sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle_)));
+    }
+    sqlite3_bind_text(stmt, 1, status.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_int(stmt, 2, id);
+
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if(rc != SQLITE_DONE) {
+        throw runtime_error("SQL error: " + string(sqlite3_errmsg(handle_)));
+    }
+}
+
+void SqliteDeviceStore::removeDevice(int id) {
+    DatabaseManager::executeSQL(handle_, "DELETE FROM devices WHERE id = " + to_string(id));
+}
+
+void SqliteDeviceStore::loadDevices(const LoadCallback& callback) {
+    const char* sql = "SELECT id, device_type, status FROM devices;";
+    sqlite3_stmt* stmt;
+
+    if(sqlite3_prepare_v2(handle_, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("数据库查询失败: " + string(sqlite3_errmsg(handle_)));
+    }
+
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        const char* type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        const char* status = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));
+        if(!type) continue;
+        callback(id, type, status ? status : "");
+    }
+    sqlite3_finalize(stmt);
+}
@@ -0,0 +1,36 @@
+#ifndef DEVICE_STATE_STORE_H
+#define DEVICE_STATE_STORE_H
+
+#include <string>
+#include <functional>
+
+struct sqlite3;
+
+// 设备状态存储接口，DatabaseManager按启动参数选择具体实现
+class DeviceStateStore {
+public:
+    using LoadCallback = std::function<void(int id, const std::string& type, const std::string& status)>;
+
+    virtual ~DeviceStateStore() = default;
+
+    virtual void insertDevice(int id, const std::string& type, const std::string& status) = 0;
+    virtual void updateDevice(int id, const std::string& type, const std::string& status) = 0;
+    virtual void removeDevice(int id) = 0;
+    virtual void loadDevices(const LoadCallback& callback) = 0;
+};
+
+// 默认实现：设备状态存放在SQLite的devices表，写入走构造时给定的连接
+class SqliteDeviceStore : public DeviceStateStore {
+public:
+    explicit SqliteDeviceStore(sqlite3* handle);
+
+    void insertDevice(int id, const std::string& type, const std::string& status) override;
+    void updateDevice(int id, const std::string& type, const std::string& status) override;
+    void removeDevice(int id) override;
+    void loadDevices(const LoadCallback& callback) override;
+
+private:
+    sqlite3* handle_;
+};
+
+#endif // DEVICE_STATE_STORE_H
@@ -0,0 +1,509 @@
+#include "DatabaseManager/LogDeviceStore.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+constexpr uint32_t RECORD_MAGIC = 0x44534C47;            // "DSLG"
+constexpr size_t RECORD_HEADER_SIZE = 12;                // magic + crc32 + payload长度
+constexpr uint32_t MAX_PAYLOAD_SIZE = 16 * 1024 * 1024;
+constexpr size_t COMPACTION_BUFFER_SIZE = 1024 * 1024;
+constexpr int COMPACTION_CATCHUP_ROUNDS = 4;             // 追赶新写入尾部的最大轮数
+
+// 定长整数按主机字节序存储，日志文件不跨平台迁移
+template<typename T>
+static void putValue(string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool getValue(const string& in, size_t& pos, T& value) {
+    if(pos + sizeof(T) > in.size()) return false;
+    memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static bool writeAll(int fd, const char* data, size_t size) {
+    while(size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if(written < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool readAll(int fd, char* data, size_t size, uint64_t offset) {
+    while(size > 0) {
+        ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            return false;
+        }
+        if(n == 0) return false;
+        data += n;
+        size -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+LogDeviceStore::LogDeviceStore(const string& path, LogStoreOptions options)
+    : path_(path), options_(options)
+{
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd_ < 0) {
+        throw runtime_error("设备日志打开失败: " + path_ + ": " + strerror(errno));
+    }
+    recover();
+
+    running_ = true;
+    committer_ = thread(&LogDeviceStore::committerLoop, this);
+    compactor_ = thread(&LogDeviceStore::compactorLoop, this);
+}
+
+LogDeviceStore::~LogDeviceStore() {
+    shutdown();
+    if(fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+//--------------------- 写入与组提交 ---------------------
+void LogDeviceStore::insertDevice(int id, const string& type, const string& status) {
+    append(RecordOp::PUT, id, type, status);
+}
+
+void LogDeviceStore::updateDevice(int id, const string& type, const string& status) {
+    append(RecordOp::PUT, id, type, status);
+}
+
+void LogDeviceStore::removeDevice(int id) {
+    append(RecordOp::REMOVE, id, "", "");
+}
+
+void LogDeviceStore::append(RecordOp op, int id, const string& type, const string& status) {
+    string bytes = encode(op, id, type, status);
+
+    unique_lock<mutex> lock(mutex_);
+    if(!running_) {
+        throw runtime_error("设备日志已关闭: " + path_);
+    }
+    if(failed_) {
+        throw runtime_error("设备日志写入失败: " + path_);
+    }
+
+    pending_.push_back({op, id, move(bytes)});
+    uint64_t seq = ++appendSeq_;
+    commitCv_.notify_one();
+
+    // 等待所在批次落盘，同一批次内的写入共享一次fdatasync
+    if(options_.syncOnCommit) {
+        durableCv_.wait(lock, [&] { return durableSeq_ >= seq; });
+        if(failed_) {
+            throw runtime_error("设备日志写入失败: " + path_);
+        }
+    }
+}
+
+void LogDeviceStore::committerLoop() {
+    while(true) {
+        vector<PendingRecord> batch;
+        uint64_t seq;
+        {
+            unique_lock<mutex> lock(mutex_);
+            commitCv_.wait(lock, [this] { return !pending_.empty() || !running_; });
+            if(pending_.empty() && !running_) break;
+
+            if(options_.commitInterval.count() > 0 && running_) {
+                commitCv_.wait_for(lock, options_.commitInterval, [this] { return !running_; });
+            }
+            swap(batch, pending_);
+            seq = appendSeq_;
+        }
+
+        bool ok = writeBatch(batch);
+        bool compactNeeded = ok && needsCompaction();
+        {
+            lock_guard<mutex> lock(mutex_);
+            if(!ok) failed_ = true;
+            durableSeq_ = seq;
+            if(compactNeeded) compactRequested_ = true;
+        }
+        durableCv_.notify_all();
+        if(compactNeeded) {
+            compactCv_.notify_one();
+        }
+    }
+}
+
+bool LogDeviceStore::writeBatch(vector<PendingRecord>& batch) {
+    lock_guard<mutex> lock(indexMutex_);
+
+    string buffer;
+    size_t total = 0;
+    for(const auto& record : batch) total += record.bytes.size();
+    buffer.reserve(total);
+    for(const auto& record : batch) buffer += record.bytes;
+
+    if(!writeAll(fd_, buffer.data(), buffer.size())) {
+        cerr << "设备日志写入失败: " << strerror(errno) << endl;
+        return false;
+    }
+    if(options_.syncOnCommit && ::fdatasync(fd_) != 0) {
+        cerr << "设备日志同步失败: " << strerror(errno) << endl;
+        return false;
+    }
+
+    // 落盘后再更新索引，索引只指向完整记录
+    uint64_t offset = fileSize_;
+    for(const auto& record : batch) {
+        uint32_t size = static_cast<uint32_t>(record.bytes.size());
+        auto it = index_.find(record.id);
+        if(it != index_.end()) {
+            liveBytes_ -= it->second.size;
+        }
+        if(record.op == RecordOp::PUT) {
+            index_[record.id] = {offset, size};
+            liveBytes_ += size;
+        } else if(it != index_.end()) {
+            index_.erase(it);
+        }
+        offset += size;
+    }
+    fileSize_ = offset;
+    return true;
+}
+
+//--------------------- 读取与恢复 ---------------------
+void LogDeviceStore::loadDevices(const LoadCallback& callback) {
+    lock_guard<mutex> lock(indexMutex_);
+    string type, status;
+    for(const auto& [id, entry] : index_) {
+        if(readRecord(entry.offset, entry.size, type, status)) {
+            callback(id, type, status);
+        } else {
+            cerr << "设备日志记录读取失败: " << id << endl;
+        }
+    }
+}
+
+void LogDeviceStore::recover() {
+    struct stat st;
+    if(::fstat(fd_, &st) != 0) {
+        throw runtime_error("设备日志读取失败: " + path_ + ": " + strerror(errno));
+    }
+
+    // 压缩使文件大小与有效数据成正比，一次性读入后顺序扫描
+    string data(static_cast<size_t>(st.st_size), '\0');
+    if(!data.empty() && !readAll(fd_, &data[0], data.size(), 0)) {
+        throw runtime_error("设备日志读取失败: " + path_ + ": " + strerror(errno));
+    }
+
+    size_t offset = 0;
+    size_t validEnd = 0;
+    while(offset + RECORD_HEADER_SIZE <= data.size()) {
+        RecordOp op;
+        int id;
+        string type, status;
+        uint32_t size = 0;
+        if(!parseRecord(data, offset, op, id, type, status, size)) {
+            // 中间的损坏记录：跳到下一条能通过校验的记录，后面的有效记录不能丢
+            size_t next = offset + 1;
+            while(next + RECORD_HEADER_SIZE <= data.size() &&
+                  !parseRecord(data, next, op, id, type, status, size)) {
+                ++next;
+            }
+            if(next + RECORD_HEADER_SIZE > data.size()) break;
+            cerr << "设备日志记录损坏，跳过 " << next - offset << " 字节" << endl;
+            offset = next;
+        }
+
+        auto it = index_.find(id);
+        if(it != index_.end()) {
+            liveBytes_ -= it->second.size;
+        }
+        if(op == RecordOp::PUT) {
+            index_[id] = {offset, size};
+            liveBytes_ += size;
+        } else if(it != index_.end()) {
+            index_.erase(it);
+        }
+        offset += size;
+        validEnd = offset;
+    }
+
+    // 最后一条有效记录之后没有任何可用数据（崩溃时写了一半的记录）：截断
+    if(validEnd < data.size()) {
+        cerr << "设备日志尾部损坏，截断 " << data.size() - validEnd << " 字节" << endl;
+        if(::ftruncate(fd_, static_cast<off_t>(validEnd)) != 0) {
+            throw runtime_error("设备日志截断失败: " + path_ + ": " + strerror(errno));
+        }
+    }
+    fileSize_ = validEnd;
+}
+
+bool LogDeviceStore::readRecord(uint64_t offset, uint32_t size, string& type, string& status) {
+    string record(size, '\0');
+    if(size < RECORD_HEADER_SIZE || !readAll(fd_, &record[0], size, offset)) return false;
+
+    RecordOp op;
+    int id;
+    uint32_t parsedSize = 0;
+    return parseRecord(record, 0, op, id, type, status, parsedSize) &&
+           parsedSize == size && op == RecordOp::PUT;
+}
+
+// 校验并解析data中offset处的一条完整记录，size返回记录总长度
+bool LogDeviceStore::parseRecord(const string& data, size_t offset, RecordOp& op, int& id,
+                                 string& type, string& status, uint32_t& size) {
+    size_t pos = offset;
+    uint32_t magic = 0, crc = 0, length = 0;
+    if(!getValue(data, pos, magic) || magic != RECORD_MAGIC) return false;
+    if(!getValue(data, pos, crc) || !getValue(data, pos, length)) return false;
+    if(length > MAX_PAYLOAD_SIZE || pos + length > data.size()) return false;
+    if(crc32(data.data() + pos, length) != crc) return false;
+    if(!decode(data.substr(pos, length), op, id, type, status)) return false;
+
+    size = static_cast<uint32_t>(RECORD_HEADER_SIZE + length);
+    return true;
+}
+
+//--------------------- 后台压缩 ---------------------
+bool LogDeviceStore::needsCompaction() {
+    lock_guard<mutex> lock(indexMutex_);
+    return fileSize_ >= options_.minCompactionBytes &&
+           static_cast<double>(liveBytes_) < static_cast<double>(fileSize_) * options_.compactionRatio;
+}
+
+void LogDeviceStore::compactorLoop() {
+    while(true) {
+        {
+            unique_lock<mutex> lock(mutex_);
+            compactCv_.wait(lock, [this] { return compactRequested_ || !running_; });
+            if(!running_) break;
+            compactRequested_ = false;
+        }
+        // 上一次压缩期间累积的请求可能已经不需要了
+        if(needsCompaction()) {
+            compact();
+        }
+    }
+}
+
+// 把旧文件[begin, end)区间的原始字节追加到out
+bool LogDeviceStore::copyRange(int out, uint64_t begin, uint64_t end) {
+    string buffer;
+    while(begin < end) {
+        size_t chunk = static_cast<size_t>(min<uint64_t>(end - begin, COMPACTION_BUFFER_SIZE));
+        buffer.resize(chunk);
+        if(!readAll(fd_, &buffer[0], chunk, begin) || !writeAll(out, buffer.data(), chunk)) return false;
+        begin += chunk;
+    }
+    return true;
+}
+
+void LogDeviceStore::compact() {
+    // 在压缩线程内执行，fd_只在本线程中替换，因此无锁读取旧文件是安全的。
+    // 1. 短暂加锁取索引快照：base之前的文件内容不再变化
+    unordered_map<int, IndexEntry> snapshot;
+    uint64_t base;
+    {
+        lock_guard<mutex> lock(indexMutex_);
+        snapshot = index_;
+        base = fileSize_;
+    }
+
+    string tmpPath = path_ + ".compact";
+    int out = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(out < 0) {
+        cerr << "设备日志压缩失败: " << strerror(errno) << endl;
+        return;
+    }
+
+    // 2. 不持锁重写快照中的有效记录
+    unordered_map<int, uint64_t> movedOffsets;
+    movedOffsets.reserve(snapshot.size());
+    string buffer;
+    uint64_t snapshotSize = 0;
+    bool ok = true;
+
+    for(const auto& [id, entry] : snapshot) {
+        if(!running_) {
+            ok = false;
+            break;
+        }
+        size_t pos = buffer.size();
+        buffer.resize(pos + entry.size);
+        if(!readAll(fd_, &buffer[pos], entry.size, entry.offset)) {
+            ok = false;
+            break;
+        }
+        movedOffsets[id] = snapshotSize;
+        snapshotSize += entry.size;
+
+        if(buffer.size() >= COMPACTION_BUFFER_SIZE) {
+            if(!writeAll(out, buffer.data(), buffer.size())) {
+                ok = false;
+                break;
+            }
+            buffer.clear();
+        }
+    }
+    if(ok) ok = writeAll(out, buffer.data(), buffer.size());
+
+    // 3. 不持锁追赶压缩期间提交的新记录，原样复制到新文件末尾
+    uint64_t copied = base;
+    for(int round = 0; ok && round < COMPACTION_CATCHUP_ROUNDS; ++round) {
+        uint64_t end;
+        {
+            lock_guard<mutex> lock(indexMutex_);
+            end = fileSize_;
+        }
+        if(end - copied < COMPACTION_BUFFER_SIZE) break;
+        ok = copyRange(out, copied, end);
+        copied = end;
+    }
+    if(ok) ok = (::fdatasync(out) == 0);
+
+    if(!ok) {
+        cerr << "设备日志压缩失败: " << strerror(errno) << endl;
+        ::close(out);
+        ::unlink(tmpPath.c_str());
+        return;
+    }
+
+    // 4. 加锁复制剩余的少量尾部，切换文件并重建索引
+    lock_guard<mutex> lock(indexMutex_);
+    ok = copyRange(out, copied, fileSize_) && ::fdatasync(out) == 0;
+    ::close(out);
+
+    unordered_map<int, IndexEntry> newIndex;
+    newIndex.reserve(index_.size());
+    for(const auto& [id, entry] : index_) {
+        if(entry.offset >= base) {
+            newIndex[id] = {snapshotSize + (entry.offset - base), entry.size};
+            continue;
+        }
+        // base之前的记录在快照之后没有被覆盖，必然在快照中
+        auto it = movedOffsets.find(id);
+        if(it == movedOffsets.end()) {
+            ok = false;
+            break;
+        }
+        newIndex[id] = {it->second, entry.size};
+    }
+
+    int newFd = -1;
+    if(ok) ok = (::rename(tmpPath.c_str(), path_.c_str()) == 0);
+    if(ok) {
+        newFd = ::open(path_.c_str(), O_RDWR | O_APPEND, 0644);
+        ok = (newFd >= 0);
+    }
+    if(!ok) {
+        cerr << "设备日志压缩失败: " << strerror(errno) << endl;
+        ::unlink(tmpPath.c_str());
+        return;
+    }
+
+    ::close(fd_);
+    fd_ = newFd;
+    fileSize_ = snapshotSize + (fileSize_ - base);
+    index_ = move(newIndex);
+}
+
+void LogDeviceStore::shutdown() {
+    if(running_) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            running_ = false;
+        }
+        commitCv_.notify_all();
+        compactCv_.notify_all();
+        if(committer_.joinable()) {
+            committer_.join();
+        }
+        if(compactor_.joinable()) {
+            compactor_.join();
+        }
+    }
+}
+
+uint64_t LogDeviceStore::fileSize() {
+    lock_guard<mutex> lock(indexMutex_);
+    return fileSize_;
+}
+
+uint64_t LogDeviceStore::liveBytes() {
+    lock_guard<mutex> lock(indexMutex_);
+    return liveBytes_;
+}
+
+//--------------------- 记录编解码 ---------------------
+string LogDeviceStore::encode(RecordOp op, int id, const string& type, const string& status) {
+    string payload;
+    payload.reserve(11 + type.size() + status.size());
+    putValue(payload, static_cast<uint8_t>(op));
+    putValue(payload, static_cast<int32_t>(id));
+    putValue(payload, static_cast<uint16_t>(type.size()));
+    payload += type;
+    putValue(payload, static_cast<uint32_t>(status.size()));
+    payload += status;
+
+    string record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+    putValue(record, RECORD_MAGIC);
+    putValue(record, crc32(payload.data(), payload.size()));
+    putValue(record, static_cast<uint32_t>(payload.size()));
+    record += payload;
+    return record;
+}
+
+bool LogDeviceStore::decode(const string& payload, RecordOp& op, int& id, string& type, string& status) {
+    size_t pos = 0;
+    uint8_t rawOp;
+    int32_t rawId;
+    uint16_t typeSize;
+    uint32_t statusSize;
+
+    if(!getValue(payload, pos, rawOp) || !getValue(payload, pos, rawId)) return false;
+    if(!getValue(payload, pos, typeSize) || pos + typeSize > payload.size()) return false;
+    type.assign(payload, pos, typeSize);
+    pos += typeSize;
+    if(!getValue(payload, pos, statusSize) || pos + statusSize != payload.size()) return false;
+    status.assign(payload, pos, statusSize);
+
+    op = static_cast<RecordOp>(rawOp);
+    id = rawId;
+    return op == RecordOp::PUT || op == RecordOp::REMOVE;
+}
+
+uint32_t LogDeviceStore::crc32(const char* data, size_t size) {
+    static const array<uint32_t, 256> table = [] {
+        array<uint32_t, 256> t{};
+        for(uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for(int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for(size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
@@ -0,0 +1,107 @@
+#ifndef LOG_DEVICE_STORE_H
+#define LOG_DEVICE_STORE_H
+
+#include "DatabaseManager/DeviceStateStore.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+
+struct LogStoreOptions {
+    bool syncOnCommit = true;                                    // 写入是否等待fdatasync完成
+    std::chrono::milliseconds commitInterval{2};                 // 组提交最长等待时间
+    double compactionRatio = 0.5;                                // 有效数据占比低于此值时压缩
+    uint64_t minCompactionBytes = 4ull * 1024 * 1024;            // 文件小于此值不压缩
+};
+
+// 追加写日志结构的设备状态存储
+// 记录格式：[magic][crc32][payload长度][payload]，payload = [操作][设备ID][类型][状态]
+// 写入先进入内存批次，由后台线程组提交（一次write + 一次fdatasync）；
+// 内存索引记录每个设备最新记录的位置，垃圾比例过高时由独立的压缩线程重写为只含有效记录的新文件，
+// 重写期间提交照常进行，只在最后切换文件和索引时短暂加锁。
+// 启动时顺序扫描并校验：中间的损坏记录被跳过，只有其后再无有效记录时才截断尾部；
+// 压缩保证文件大小与有效数据成正比，从而限制恢复时间。
+class LogDeviceStore : public DeviceStateStore {
+public:
+    explicit LogDeviceStore(const std::string& path, LogStoreOptions options = LogStoreOptions());
+    ~LogDeviceStore() override;
+
+    LogDeviceStore(const LogDeviceStore&) = delete;
+    LogDeviceStore& operator=(const LogDeviceStore&) = delete;
+
+    void insertDevice(int id, const std::string& type, const std::string& status) override;
+    void updateDevice(int id, const std::string& type, const std::string& status) override;
+    void removeDevice(int id) override;
+    void loadDevices(const LoadCallback& callback) override;
+
+    void shutdown();
+    uint64_t fileSize();
+    uint64_t liveBytes();
+
+private:
+    enum class RecordOp : uint8_t {
+        PUT = 1,
+        REMOVE = 2
+    };
+
+    struct PendingRecord {
+        RecordOp op;
+        int id;
+        std::string bytes;
+    };
+
+    struct IndexEntry {
+        uint64_t offset;
+        uint32_t size;
+    };
+
+    std::string path_;
+    LogStoreOptions options_;
+    int fd_ = -1;
+    uint64_t fileSize_ = 0;
+
+    // 待提交批次，由mutex_保护
+    std::vector<PendingRecord> pending_;
+    uint64_t appendSeq_ = 0;
+    uint64_t durableSeq_ = 0;
+    bool failed_ = false;
+    std::mutex mutex_;
+    std::condition_variable commitCv_;
+    std::condition_variable durableCv_;
+
+    // 设备ID -> 最新记录位置，由indexMutex_保护
+    std::unordered_map<int, IndexEntry> index_;
+    uint64_t liveBytes_ = 0;
+    std::mutex indexMutex_;
+
+    std::atomic<bool> running_{false};
+    std::thread committer_;
+
+    // 压缩请求由提交线程发出，compactRequested_由mutex_保护
+    bool compactRequested_ = false;
+    std::condition_variable compactCv_;
+    std::thread compactor_;
+
+    void append(RecordOp op, int id, const std::string& type, const std::string& status);
+    void committerLoop();
+    bool writeBatch(std::vector<PendingRecord>& batch);
+    void recover();
+    bool needsCompaction();
+    void compactorLoop();
+    void compact();
+    bool copyRange(int out, uint64_t begin, uint64_t end);
+
+    bool readRecord(uint64_t offset, uint32_t size, std::string& type, std::string& status);
+    static bool parseRecord(const std::string& data, size_t offset, RecordOp& op, int& id,
+                            std::string& type, std::string& status, uint32_t& size);
+    static std::string encode(RecordOp op, int id, const std::string& type, const std::string& status);
+    static bool decode(const std::string& payload, RecordOp& op, int& id, std::string& type, std::string& status);
+    static uint32_t crc32(const char* data, size_t size);
+};
+
+#endif // LOG_DEVICE_STORE_H
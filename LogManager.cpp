@@ -17,12 +17,15 @@ LogManager& LogManager::getInstance() {
     return instance;
 }
 
-void LogManager::init(const std::string& logDir, size_t maxFileSize, int maxBackups) {
+void LogManager::init(const std::string& logDir, size_t maxFileSize, int maxBackups,
+                      size_t maxQueueSize, OverflowPolicy policy) {
     if (running_) return;
 
     logDir_ = fs::path(logDir);
     maxFileSize_ = maxFileSize;
     maxBackups_ = maxBackups;
+    maxQueueSize_ = std::max<size_t>(1, maxQueueSize);
+    policy_ = policy;
     
     fs::create_directories(logDir_);
     createNewLogFile();
@@ -39,16 +42,86 @@ void LogManager::log(LogType type, const std::string& message, int userId, int d
         type,
         message,
         userId,
-        deviceId
+        deviceId,
+        0
     };
 
     {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        logQueue_.push(entry);
+        std::unique_lock<std::mutex> lock(queueMutex_);
+        if (queuedTotal_ >= maxQueueSize_) {
+            if (policy_ == OverflowPolicy::BLOCK) {
+                notFullCv_.wait(lock, [this] {
+                    return queuedTotal_ < maxQueueSize_ || !running_;
+                });
+                if (!running_) return;
+            } else if (!makeRoom(type)) {
+                ++droppedCounts_[static_cast<size_t>(type)];
+                return;
+            }
+        }
+        entry.sequence = nextSequence_++;
+        queues_[static_cast<size_t>(type)].push_back(std::move(entry));
+        ++queuedTotal_;
     }
     cv_.notify_one();
 }
 
+int LogManager::getPriority(LogType type) {
+    switch (type) {
+        case LogType::DEVICE_OPERATION: return 0;
+        case LogType::USER_ACTION:      return 1;
+        case LogType::SYSTEM_EVENT:     return 2;
+        case LogType::ERROR_LOG:        return 3;
+        default:                        return 0;
+    }
+}
+
+// 队列已满时腾出一个位置，返回false表示应丢弃新日志（调用方需持有queueMutex_）
+// 只检查各类型队列的队头，开销与队列长度无关
+bool LogManager::makeRoom(LogType incoming) {
+    if (policy_ == OverflowPolicy::DROP_OLDEST) {
+        size_t queue = oldestQueue();
+        ++droppedCounts_[queue];
+        popFront(queue);
+        return true;
+    }
+
+    // 从最低优先级开始找比新日志优先级低的类型，丢弃其中最早的一条
+    int incomingPriority = getPriority(incoming);
+    for (int priority = 0; priority < incomingPriority; ++priority) {
+        for (size_t t = 0; t < LOG_TYPE_COUNT; ++t) {
+            if (getPriority(static_cast<LogType>(t)) != priority || queues_[t].empty()) continue;
+            ++droppedCounts_[t];
+            popFront(t);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 队头序号最小的非空队列（调用方需持有queueMutex_且队列非空）
+size_t LogManager::oldestQueue() const {
+    size_t oldest = LOG_TYPE_COUNT;
+    for (size_t t = 0; t < LOG_TYPE_COUNT; ++t) {
+        if (queues_[t].empty()) continue;
+        if (oldest == LOG_TYPE_COUNT || queues_[t].front().sequence < queues_[oldest].front().sequence) {
+            oldest = t;
+        }
+    }
+    return oldest;
+}
+
+LogManager::LogEntry LogManager::popFront(size_t queue) {
+    LogEntry entry = std::move(queues_[queue].front());
+    queues_[queue].pop_front();
+    --queuedTotal_;
+    return entry;
+}
+
+uint64_t LogManager::getDroppedCount(LogType type) const {
+    return droppedCounts_[static_cast<size_t>(type)];
+}
+
 void LogManager::workerFunction() {
     std::vector<LogEntry> batch;
     batch.reserve(BATCH_SIZE);
@@ -59,14 +132,15 @@ void LogManager::workerFunction() {
         {
             std::unique_lock<std::mutex> lock(queueMutex_);
             cv_.wait_for(lock, FLUSH_INTERVAL, [this] {
-                return !logQueue_.empty() || !running_;
+                return queuedTotal_ > 0 || !running_;
             });
 
-            while (!logQueue_.empty() && batch.size() < BATCH_SIZE) {
-                batch.push_back(logQueue_.front());
-                logQueue_.pop();
+            // 按入队顺序合并各类型队列
+            while (queuedTotal_ > 0 && batch.size() < BATCH_SIZE) {
+                batch.push_back(popFront(oldestQueue()));
             }
         }
+        notFullCv_.notify_all();
 
         if (!batch.empty()) {
             writeBatch(batch);
@@ -165,8 +239,12 @@ void LogManager::flush() {
 
 void LogManager::shutdown() {
     if (running_) {
-        running_ = false;
+        {
+            std::lock_guard<std::mutex> lock(queueMutex_);
+            running_ = false;
+        }
         cv_.notify_all();
+        notFullCv_.notify_all();
         if (workerThread_.joinable()) {
             workerThread_.join();
         }
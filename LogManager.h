@@ -2,7 +2,10 @@
 #define LOG_MANAGER_H
 
 #include <string>
-#include <queue>
+#include <deque>
+#include <array>
+#include <vector>
+#include <thread>
 #include <mutex>
 #include <atomic>
 #include <condition_variable>
@@ -22,11 +25,20 @@ public:
         ERROR_LOG
     };
 
+    // 日志队列满时的处理策略
+    enum class OverflowPolicy {
+        BLOCK,              // 阻塞调用方直到队列有空位
+        DROP_OLDEST,        // 丢弃最早的日志
+        DROP_LOW_PRIORITY   // 优先丢弃低优先级日志（DEVICE_OPERATION 先于 ERROR_LOG）
+    };
+
     static LogManager& getInstance();
     
     void init(const std::string& logDir = "logs", 
              size_t maxFileSize = 10'485'760,  // 10MB
-             int maxBackups = 5);
+             int maxBackups = 5,
+             size_t maxQueueSize = 100'000,
+             OverflowPolicy policy = OverflowPolicy::DROP_LOW_PRIORITY);
     
     void log(LogType type, 
             const std::string& message, 
@@ -36,6 +48,8 @@ public:
     void flush();
     void shutdown();
 
+    uint64_t getDroppedCount(LogType type) const;
+
 private:
     LogManager() = default;
     ~LogManager();
@@ -46,11 +60,21 @@ private:
         std::string message;
         int userId;
         int deviceId;
+        uint64_t sequence;      // 全局入队序号，写出时按此恢复原始顺序
     };
 
-    std::queue<LogEntry> logQueue_;
+    static constexpr size_t LOG_TYPE_COUNT = 4;
+
+    // 每种类型一个队列，溢出时丢弃只需操作某个队列的队头
+    std::array<std::deque<LogEntry>, LOG_TYPE_COUNT> queues_;
+    size_t queuedTotal_ = 0;
+    uint64_t nextSequence_ = 0;
     std::mutex queueMutex_;
     std::condition_variable cv_;
+    std::condition_variable notFullCv_;
+    size_t maxQueueSize_ = 100'000;
+    OverflowPolicy policy_ = OverflowPolicy::DROP_LOW_PRIORITY;
+    std::array<std::atomic<uint64_t>, LOG_TYPE_COUNT> droppedCounts_{};
     std::atomic<bool> running_{false};
     
     fs::path logDir_;
@@ -64,6 +88,10 @@ private:
     void workerFunction();
     void rotateLog();
     std::string getTypeString(LogType type) const;
+    static int getPriority(LogType type);
+    bool makeRoom(LogType incoming);
+    size_t oldestQueue() const;
+    LogEntry popFront(size_t queue);
     void writeBatch(const std::vector<LogEntry>& batch);
     void createNewLogFile();
 };
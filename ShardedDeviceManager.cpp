@@ -0,0 +1,288 @@
+#include "DeviceManager/ShardedDeviceManager.h"
+#include <iostream>
+#include <stdexcept>
+#include <sqlite3.h>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+// FNV-1a：结果不依赖标准库实现，同一家庭在任何构建下都映射到同一分片
+static uint64_t fnv1a(const string& value) {
+    uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : value) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static string shardPath(const string& dbPrefix, size_t index) {
+    return dbPrefix + "_shard" + to_string(index) + ".db";
+}
+
+// 读取建库时记录的分片数，新库返回0
+static size_t readShardCount(DatabaseManager& db) {
+    db.executeSQL(
+        "CREATE TABLE IF NOT EXISTS shard_info ("
+        "shard_index INTEGER NOT NULL,"
+        "shard_count INTEGER NOT NULL);"
+    );
+
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT shard_count FROM shard_info LIMIT 1;";
+    if(sqlite3_prepare_v2(db.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("数据库查询失败: " + string(sqlite3_errmsg(db.getHandle())));
+    }
+    size_t count = 0;
+    if(sqlite3_step(stmt) == SQLITE_ROW) {
+        count = static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// 新库写入分片编号和分片数；已有库必须与当前配置一致
+static void initShardInfo(DatabaseManager& db, size_t index, size_t count) {
+    size_t stored = readShardCount(db);
+    if(stored == 0) {
+        db.executeSQL("INSERT INTO shard_info (shard_index, shard_count) VALUES (" +
+                      to_string(index) + ", " + to_string(count) + ");");
+    } else if(stored != count) {
+        throw runtime_error("分片数与已有数据不一致: 当前 " + to_string(count) +
+                            "，建库时 " + to_string(stored));
+    }
+
+    // 设备所属家庭
+    db.executeSQL(
+        "CREATE TABLE IF NOT EXISTS device_homes ("
+        "device_id INTEGER PRIMARY KEY,"
+        "home_id TEXT NOT NULL);"
+    );
+}
+
+static void loadHomes(DatabaseManager& db, unordered_map<int, string>& homes) {
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT device_id, home_id FROM device_homes;";
+    if(sqlite3_prepare_v2(db.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw runtime_error("数据库查询失败: " + string(sqlite3_errmsg(db.getHandle())));
+    }
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        homes[sqlite3_column_int(stmt, 0)] = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    }
+    sqlite3_finalize(stmt);
+}
+
+static bool saveHome(DatabaseManager& db, int deviceId, const string& homeId) {
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT OR REPLACE INTO device_homes (device_id, home_id) VALUES (?, ?);";
+    if(sqlite3_prepare_v2(db.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "数据库错误: " << sqlite3_errmsg(db.getHandle()) << endl;
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, deviceId);
+    sqlite3_bind_text(stmt, 2, homeId.c_str(), -1, SQLITE_STATIC);
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+ShardedDeviceManager::ShardedDeviceManager(size_t shardCount, const string& dbPrefix) {
+    // 未指定分片数时沿用建库时的值，避免在核数不同的机器上把家庭映射到其他分片
+    auto firstDb = make_unique<DatabaseManager>(shardPath(dbPrefix, 0));
+    if(shardCount == 0) {
+        shardCount = readShardCount(*firstDb);
+    }
+    if(shardCount == 0) {
+        shardCount = max(1u, thread::hardware_concurrency());
+    }
+
+    // 每个分片使用独立的数据库文件，彼此之间没有共享状态
+    shards_.reserve(shardCount);
+    for(size_t i = 0; i < shardCount; ++i) {
+        auto shard = make_unique<Shard>();
+        shard->db = (i == 0) ? move(firstDb) : make_unique<DatabaseManager>(shardPath(dbPrefix, i));
+        initShardInfo(*shard->db, i, shardCount);
+        loadHomes(*shard->db, shard->homes);
+        shard->devices = make_unique<DeviceManager>(*shard->db, "");
+        shards_.push_back(move(shard));
+    }
+
+    running_ = true;
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        shards_[i]->worker = thread(&ShardedDeviceManager::runShard, this, i);
+        pinToCore(shards_[i]->worker, i);
+    }
+}
+
+ShardedDeviceManager::~ShardedDeviceManager() {
+    shutdown();
+}
+
+size_t ShardedDeviceManager::shardFor(const string& homeId) const {
+    return fnv1a(homeId) % shards_.size();
+}
+
+bool ShardedDeviceManager::ownsDevice(const Shard& shard, const string& homeId, int deviceId) const {
+    auto it = shard.homes.find(deviceId);
+    return it != shard.homes.end() && it->second == homeId;
+}
+
+future<int> ShardedDeviceManager::addDevice(const string& homeId, const string& type, const string& config) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [shard, homeId, type, config](DeviceManager& devices) {
+        int deviceId;
+        if(!devices.addDevice(type, config, deviceId)) return -1;
+
+        // 归属写入失败时撤销设备，避免留下无主设备
+        if(!saveHome(*shard->db, deviceId, homeId)) {
+            devices.removeDevice(deviceId);
+            return -1;
+        }
+        shard->homes[deviceId] = homeId;
+        return deviceId;
+    });
+}
+
+future<bool> ShardedDeviceManager::removeDevice(const string& homeId, int deviceId) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [this, shard, homeId, deviceId](DeviceManager& devices) {
+        if(!ownsDevice(*shard, homeId, deviceId) || !devices.removeDevice(deviceId)) return false;
+
+        shard->homes.erase(deviceId);
+        try {
+            shard->db->executeSQL("DELETE FROM device_homes WHERE device_id = " + to_string(deviceId));
+        } catch(const exception& e) {
+            cerr << "设备归属删除失败: " << e.what() << endl;
+        }
+        return true;
+    });
+}
+
+future<bool> ShardedDeviceManager::setDeviceStatus(const string& homeId, int deviceId, const string& command) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [this, shard, homeId, deviceId, command](DeviceManager& devices) {
+        return ownsDevice(*shard, homeId, deviceId) && devices.admitCommand(deviceId)
+            && devices.setDeviceStatus(deviceId, command);
+    });
+}
+
+future<bool> ShardedDeviceManager::setDeviceStatus(const string& sessionId, const string& homeId,
+                                                   int deviceId, const string& command) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [this, shard, sessionId, homeId, deviceId, command](DeviceManager& devices) {
+        return ownsDevice(*shard, homeId, deviceId) && devices.setDeviceStatus(sessionId, deviceId, command);
+    });
+}
+
+future<string> ShardedDeviceManager::getDeviceStatus(const string& homeId, int deviceId) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [this, shard, homeId, deviceId](DeviceManager& devices) {
+        return ownsDevice(*shard, homeId, deviceId) ? devices.getDeviceStatus(deviceId) : string();
+    });
+}
+
+future<string> ShardedDeviceManager::getDeviceStatus(const string& sessionId, const string& homeId, int deviceId) {
+    Shard* shard = shards_[shardFor(homeId)].get();
+    return execute(homeId, [this, shard, sessionId, homeId, deviceId](DeviceManager& devices) {
+        return ownsDevice(*shard, homeId, deviceId) ? devices.getDeviceStatus(sessionId, deviceId) : string();
+    });
+}
+
+void ShardedDeviceManager::setUserManager(UserManager* users) {
+    applyToAllShards([users](DeviceManager& devices) { devices.setUserManager(users); });
+}
+
+void ShardedDeviceManager::setAdmissionController(AdmissionController* controller) {
+    applyToAllShards([controller](DeviceManager& devices) { devices.setAdmissionController(controller); });
+}
+
+void ShardedDeviceManager::applyToAllShards(const function<void(DeviceManager&)>& fn) {
+    // 在各分片线程上修改，与分片上正在处理的请求不产生数据竞争
+    vector<future<void>> pending;
+    for(size_t i = 0; i < shards_.size(); ++i) {
+        DeviceManager& devices = *shards_[i]->devices;
+        auto task = make_shared<packaged_task<void()>>([&devices, &fn] { fn(devices); });
+        pending.push_back(task->get_future());
+        post(i, [task] { (*task)(); });
+    }
+    for(auto& result : pending) {
+        try {
+            result.get();
+        } catch(const future_error&) {
+            // 已关闭的分片丢弃任务
+        }
+    }
+}
+
+void ShardedDeviceManager::post(size_t index, function<void()> task) {
+    Shard& shard = *shards_[index];
+    {
+        lock_guard<mutex> lock(shard.mailboxMutex);
+        // 已关闭时丢弃任务，调用方的future会收到broken_promise
+        if(!running_) return;
+        shard.mailbox.push(move(task));
+    }
+    shard.cv.notify_one();
+}
+
+void ShardedDeviceManager::runShard(size_t index) {
+    Shard& shard = *shards_[index];
+    queue<function<void()>> batch;
+
+    while(true) {
+        {
+            unique_lock<mutex> lock(shard.mailboxMutex);
+            shard.cv.wait(lock, [&] { return !shard.mailbox.empty() || !running_; });
+            if(shard.mailbox.empty() && !running_) break;
+            swap(batch, shard.mailbox);
+        }
+
+        // 在锁外批量执行，投递方不会被设备操作阻塞
+        while(!batch.empty()) {
+            try {
+                batch.front()();
+            } catch(const exception& e) {
+                cerr << "分片" << index << "任务执行失败: " << e.what() << endl;
+            }
+            batch.pop();
+        }
+    }
+}
+
+void ShardedDeviceManager::pinToCore(thread& worker, size_t core) {
+#ifdef __linux__
+    unsigned int cores = thread::hardware_concurrency();
+    if(cores == 0) return;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(core % cores, &cpuset);
+    if(pthread_setaffinity_np(worker.native_handle(), sizeof(cpu_set_t), &cpuset) != 0) {
+        cerr << "分片线程绑核失败: core " << core % cores << endl;
+    }
+#else
+    (void)worker;
+    (void)core;
+#endif
+}
+
+void ShardedDeviceManager::shutdown() {
+    if(running_) {
+        {
+            // 持有所有邮箱锁再置位，避免工作线程错过唤醒
+            for(auto& shard : shards_) shard->mailboxMutex.lock();
+            running_ = false;
+            for(auto& shard : shards_) shard->mailboxMutex.unlock();
+        }
+        for(auto& shard : shards_) {
+            shard->cv.notify_all();
+            if(shard->worker.joinable()) {
+                shard->worker.join();
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef SHARDED_DEVICE_MANAGER_H
+#define SHARDED_DEVICE_MANAGER_H
+
+#include "DatabaseManager/DatabaseManager.h"
+#include "DeviceManager/DeviceManager.h"
+#include <memory>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+// 分片设备管理器：按家庭/租户ID将设备划分到N个分片
+// 每个分片绑定一个CPU核心，独占自己的设备表、SQLite文件和命令队列
+// 所有请求以消息形式投递到目标分片的工作线程执行，分片之间不共享锁
+// 分片数在建库时写入各分片数据库，之后以不同分片数启动会被拒绝（家庭会被映射到其他分片）
+class ShardedDeviceManager {
+public:
+    ShardedDeviceManager(size_t shardCount, const std::string& dbPrefix);
+    ~ShardedDeviceManager();
+
+    ShardedDeviceManager(const ShardedDeviceManager&) = delete;
+    ShardedDeviceManager& operator=(const ShardedDeviceManager&) = delete;
+
+    size_t shardCount() const { return shards_.size(); }
+    size_t shardFor(const std::string& homeId) const;
+
+    // 设备接口（设备ID在分片内唯一，调用方以 homeId + deviceId 定位设备）
+    // 同一分片上的家庭共享ID空间，每个设备记录所属家庭，跨家庭访问一律失败
+    // addDevice 返回新设备ID，失败时为-1
+    std::future<int> addDevice(const std::string& homeId, const std::string& type, const std::string& config);
+    std::future<bool> removeDevice(const std::string& homeId, int deviceId);
+    // 无会话的控制命令只检查设备限流；带会话的重载额外按会话权限鉴权并按用户限流
+    std::future<bool> setDeviceStatus(const std::string& homeId, int deviceId, const std::string& command);
+    std::future<bool> setDeviceStatus(const std::string& sessionId, const std::string& homeId,
+                                      int deviceId, const std::string& command);
+    std::future<std::string> getDeviceStatus(const std::string& homeId, int deviceId);
+    std::future<std::string> getDeviceStatus(const std::string& sessionId, const std::string& homeId, int deviceId);
+
+    // 为所有分片设置会话来源和准入控制器（不转移所有权），在各分片线程上生效后返回
+    // 设备权限按分片内的设备ID授予，会话请求同样先经过家庭归属检查
+    void setUserManager(UserManager* users);
+    void setAdmissionController(AdmissionController* controller);
+
+    // 在homeId所属分片的线程上执行任意操作（不做家庭归属检查）
+    template<typename F>
+    auto execute(const std::string& homeId, F&& fn)
+        -> std::future<decltype(fn(std::declval<DeviceManager&>()))>;
+
+    void shutdown();
+
+private:
+    struct Shard {
+        std::unique_ptr<DatabaseManager> db;
+        std::unique_ptr<DeviceManager> devices;
+        std::unordered_map<int, std::string> homes;   // 设备ID -> 家庭ID，仅由分片线程访问
+        std::queue<std::function<void()>> mailbox;
+        std::mutex mailboxMutex;
+        std::condition_variable cv;
+        std::thread worker;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<bool> running_{false};
+
+    bool ownsDevice(const Shard& shard, const std::string& homeId, int deviceId) const;
+    void applyToAllShards(const std::function<void(DeviceManager&)>& fn);
+    void post(size_t index, std::function<void()> task);
+    void runShard(size_t index);
+    static void pinToCore(std::thread& thread, size_t core);
+};
+
+template<typename F>
+auto ShardedDeviceManager::execute(const std::string& homeId, F&& fn)
+    -> std::future<decltype(fn(std::declval<DeviceManager&>()))>
+{
+    using Result = decltype(fn(std::declval<DeviceManager&>()));
+
+    size_t index = shardFor(homeId);
+    DeviceManager& devices = *shards_[index]->devices;
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        [&devices, fn = std::forward<F>(fn)]() mutable { return fn(devices); });
+
+    auto future = task->get_future();
+    post(index, [task] { (*task)(); });
+    return future;
+}
+
+#endif // SHARDED_DEVICE_MANAGER_H
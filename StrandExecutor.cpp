@@ -0,0 +1,178 @@
+#include "DeviceManager/StrandExecutor.h"
+
+using namespace std;
+
+// 单个strand连续执行的任务上限，超过后让出线程保证公平
+constexpr size_t STRAND_BATCH_SIZE = 16;
+
+thread_local StrandExecutor* StrandExecutor::currentExecutor_ = nullptr;
+thread_local size_t StrandExecutor::currentWorker_ = 0;
+
+StrandExecutor::StrandExecutor(size_t threadCount) {
+    if(threadCount == 0) {
+        threadCount = max(1u, thread::hardware_concurrency());
+    }
+
+    for(size_t i = 0; i < threadCount; ++i) {
+        workers_.push_back(make_unique<Worker>());
+    }
+
+    running_ = true;
+    for(size_t i = 0; i < threadCount; ++i) {
+        threads_.emplace_back(&StrandExecutor::workerLoop, this, i);
+    }
+}
+
+StrandExecutor::~StrandExecutor() {
+    shutdown();
+}
+
+void StrandExecutor::enqueue(int key, function<void()> task) {
+    if(!running_) return;
+
+    shared_ptr<Strand> strand;
+    bool needSchedule = false;
+    {
+        // 持有strandsMutex_入队，releaseIfIdle不会移除刚取到的strand
+        lock_guard<mutex> lock(strandsMutex_);
+        auto& slot = strands_[key];
+        if(!slot) slot = make_shared<Strand>(key);
+        strand = slot;
+
+        // strand空闲时才需要调度，否则由正在执行它的线程继续处理
+        lock_guard<mutex> strandLock(strand->mutex);
+        strand->tasks.push(move(task));
+        if(!strand->scheduled) {
+            strand->scheduled = true;
+            needSchedule = true;
+        }
+    }
+    if(needSchedule) {
+        schedule(move(strand));
+    }
+}
+
+void StrandExecutor::schedule(shared_ptr<Strand> strand) {
+    // 工作线程内提交放入本地队列，外部提交轮询分配
+    size_t index = (currentExecutor_ == this)
+        ? currentWorker_
+        : nextWorker_.fetch_add(1, memory_order_relaxed) % workers_.size();
+    {
+        lock_guard<mutex> lock(workers_[index]->mutex);
+        workers_[index]->queue.push_back(move(strand));
+    }
+    queued_.fetch_add(1);
+    {
+        lock_guard<mutex> lock(sleepMutex_);
+    }
+    cv_.notify_one();
+}
+
+void StrandExecutor::runStrand(const shared_ptr<Strand>& strand) {
+    for(size_t i = 0; i < STRAND_BATCH_SIZE; ++i) {
+        function<void()> task;
+        {
+            lock_guard<mutex> lock(strand->mutex);
+            if(strand->tasks.empty()) break;
+            task = move(strand->tasks.front());
+            strand->tasks.pop();
+        }
+        task();
+    }
+
+    // 批次用完仍有任务，重新排队；否则释放strand，已标记删除的strand从表中移除
+    bool pending, retired;
+    {
+        lock_guard<mutex> lock(strand->mutex);
+        pending = !strand->tasks.empty();
+        retired = strand->retired;
+        if(!pending) {
+            strand->scheduled = false;
+        }
+    }
+    if(pending) {
+        schedule(strand);
+    } else if(retired) {
+        releaseIfIdle(strand);
+    }
+}
+
+void StrandExecutor::releaseIfIdle(const shared_ptr<Strand>& strand) {
+    lock_guard<mutex> lock(strandsMutex_);
+    auto it = strands_.find(strand->key);
+    if(it == strands_.end() || it->second != strand) return;
+
+    lock_guard<mutex> strandLock(strand->mutex);
+    if(strand->tasks.empty() && !strand->scheduled) {
+        strands_.erase(it);
+    }
+}
+
+bool StrandExecutor::popLocal(size_t index, shared_ptr<Strand>& strand) {
+    Worker& worker = *workers_[index];
+    lock_guard<mutex> lock(worker.mutex);
+    if(worker.queue.empty()) return false;
+    strand = move(worker.queue.front());
+    worker.queue.pop_front();
+    return true;
+}
+
+bool StrandExecutor::steal(size_t index, shared_ptr<Strand>& strand) {
+    // 从其他线程队列尾部窃取，与本地出队方向相反以减少竞争
+    for(size_t offset = 1; offset < workers_.size(); ++offset) {
+        Worker& victim = *workers_[(index + offset) % workers_.size()];
+        lock_guard<mutex> lock(victim.mutex);
+        if(victim.queue.empty()) continue;
+        strand = move(victim.queue.back());
+        victim.queue.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void StrandExecutor::workerLoop(size_t index) {
+    currentExecutor_ = this;
+    currentWorker_ = index;
+
+    while(true) {
+        shared_ptr<Strand> strand;
+        if(popLocal(index, strand) || steal(index, strand)) {
+            queued_.fetch_sub(1);
+            runStrand(strand);
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex_);
+        if(!running_ && queued_ == 0) break;
+        cv_.wait(lock, [this] { return queued_ > 0 || !running_; });
+    }
+}
+
+void StrandExecutor::removeStrand(int key) {
+    lock_guard<mutex> lock(strandsMutex_);
+    auto it = strands_.find(key);
+    if(it == strands_.end()) return;
+
+    Strand& strand = *it->second;
+    lock_guard<mutex> strandLock(strand.mutex);
+    if(strand.tasks.empty() && !strand.scheduled) {
+        strands_.erase(it);
+    } else {
+        strand.retired = true;
+    }
+}
+
+void StrandExecutor::shutdown() {
+    if(running_) {
+        {
+            lock_guard<mutex> lock(sleepMutex_);
+            running_ = false;
+        }
+        cv_.notify_all();
+        for(auto& worker : threads_) {
+            if(worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+}
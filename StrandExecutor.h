@@ -0,0 +1,85 @@
+#ifndef STRAND_EXECUTOR_H
+#define STRAND_EXECUTOR_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+
+// 工作窃取线程池 + 按键（设备ID）划分的strand
+// 同一strand内的任务严格按提交顺序、一次一个地执行；不同strand在所有核心上并行
+class StrandExecutor {
+public:
+    explicit StrandExecutor(size_t threadCount = 0);
+    ~StrandExecutor();
+
+    StrandExecutor(const StrandExecutor&) = delete;
+    StrandExecutor& operator=(const StrandExecutor&) = delete;
+
+    template<typename F>
+    auto submit(int key, F&& fn) -> std::future<decltype(fn())>;
+
+    // 键不再使用（如设备已删除）时调用；strand仍有任务或正在执行时（包括在其自身任务内调用）
+    // 只做标记，等队列清空、不再被调度后才移除，保证同一键任何时刻只有一个strand在执行
+    void removeStrand(int key);
+    void shutdown();
+
+private:
+    struct Strand {
+        explicit Strand(int strandKey) : key(strandKey) {}
+
+        const int key;
+        std::mutex mutex;
+        std::queue<std::function<void()>> tasks;
+        bool scheduled = false;
+        bool retired = false;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::shared_ptr<Strand>> queue;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    // 加锁顺序：strandsMutex_ -> Strand::mutex
+    std::unordered_map<int, std::shared_ptr<Strand>> strands_;
+    std::mutex strandsMutex_;
+
+    std::mutex sleepMutex_;
+    std::condition_variable cv_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> nextWorker_{0};
+    std::atomic<bool> running_{false};
+
+    static thread_local StrandExecutor* currentExecutor_;
+    static thread_local size_t currentWorker_;
+
+    void enqueue(int key, std::function<void()> task);
+    void schedule(std::shared_ptr<Strand> strand);
+    void runStrand(const std::shared_ptr<Strand>& strand);
+    void releaseIfIdle(const std::shared_ptr<Strand>& strand);
+    bool popLocal(size_t index, std::shared_ptr<Strand>& strand);
+    bool steal(size_t index, std::shared_ptr<Strand>& strand);
+    void workerLoop(size_t index);
+};
+
+template<typename F>
+auto StrandExecutor::submit(int key, F&& fn) -> std::future<decltype(fn())> {
+    using Result = decltype(fn());
+
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+    auto future = task->get_future();
+    enqueue(key, [task] { (*task)(); });
+    return future;
+}
+
+#endif // STRAND_EXECUTOR_H
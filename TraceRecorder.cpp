@@ -0,0 +1,205 @@
+#include "TraceRecorder/TraceRecorder.h"
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr char TRACE_MAGIC[4] = {'S', 'H', 'T', 'R'};
+constexpr uint8_t TRACE_VERSION = 1;
+constexpr auto TRACE_FLUSH_INTERVAL = milliseconds(100);
+constexpr size_t TRACE_FLUSH_BYTES = 256 * 1024;
+
+constexpr uint8_t FLAG_SUCCESS = 0x01;
+constexpr uint8_t FLAG_HAS_SESSION = 0x02;
+
+static void putVarint(string& out, uint64_t value) {
+    while(value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+static bool getVarint(istream& in, uint64_t& value) {
+    value = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        int c = in.get();
+        if(c == EOF) return false;
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if(!(c & 0x80)) return true;
+    }
+    return false;
+}
+
+static void putString(string& out, const string& value) {
+    putVarint(out, value.size());
+    out += value;
+}
+
+// 长度来自文件内容，先与剩余字节数比较，损坏的trace不会触发超大分配
+static bool getString(istream& in, string& value, uint64_t fileSize) {
+    uint64_t size;
+    if(!getVarint(in, size)) return false;
+    streamoff pos = in.tellg();
+    if(pos < 0 || size > fileSize - static_cast<uint64_t>(pos)) return false;
+    value.resize(size);
+    return size == 0 || static_cast<bool>(in.read(&value[0], static_cast<streamsize>(size)));
+}
+
+TraceRecorder::~TraceRecorder() {
+    stop();
+}
+
+TraceRecorder& TraceRecorder::getInstance() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+bool TraceRecorder::start(const string& path, size_t maxBufferBytes) {
+    if(enabled_) return false;
+
+    traceFile_.open(path, ios::binary | ios::trunc);
+    if(!traceFile_.is_open()) {
+        cerr << "trace文件打开失败: " << path << endl;
+        return false;
+    }
+
+    uint64_t wallClockNs = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    traceFile_.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    traceFile_.put(static_cast<char>(TRACE_VERSION));
+    traceFile_.write(reinterpret_cast<const char*>(&wallClockNs), sizeof(wallClockNs));
+
+    {
+        lock_guard<mutex> lock(bufferMutex_);
+        buffer_.clear();
+        maxBufferBytes_ = maxBufferBytes;
+        startTime_ = steady_clock::now();
+        lastTimestampNs_ = 0;
+    }
+    dropped_ = 0;
+    enabled_ = true;
+    writerThread_ = thread(&TraceRecorder::writerFunction, this);
+    return true;
+}
+
+void TraceRecorder::record(TraceOp op, bool success, uint64_t session, int deviceId,
+                           const string& subject, const string& payload) {
+    if(!isEnabled()) return;
+
+    {
+        lock_guard<mutex> lock(bufferMutex_);
+        // 写线程跟不上时丢弃而不是无限增长
+        if(buffer_.size() >= maxBufferBytes_) {
+            ++dropped_;
+            return;
+        }
+
+        // 时间戳在锁内获取，保证增量编码单调
+        uint64_t now = duration_cast<nanoseconds>(steady_clock::now() - startTime_).count();
+        uint8_t flags = (success ? FLAG_SUCCESS : 0) | (session ? FLAG_HAS_SESSION : 0);
+
+        buffer_.push_back(static_cast<char>(op));
+        buffer_.push_back(static_cast<char>(flags));
+        putVarint(buffer_, now - lastTimestampNs_);
+        if(session) {
+            buffer_.append(reinterpret_cast<const char*>(&session), sizeof(session));
+        }
+        putVarint(buffer_, (static_cast<uint64_t>(deviceId) << 1) ^ static_cast<uint64_t>(deviceId >> 31));
+        putString(buffer_, subject);
+        putString(buffer_, payload);
+        lastTimestampNs_ = now;
+
+        if(buffer_.size() < TRACE_FLUSH_BYTES) return;
+    }
+    cv_.notify_one();
+}
+
+void TraceRecorder::writerFunction() {
+    string pending;
+    while(true) {
+        {
+            unique_lock<mutex> lock(bufferMutex_);
+            cv_.wait_for(lock, TRACE_FLUSH_INTERVAL, [this] {
+                return buffer_.size() >= TRACE_FLUSH_BYTES || !enabled_;
+            });
+            swap(pending, buffer_);
+        }
+
+        if(!pending.empty()) {
+            traceFile_.write(pending.data(), static_cast<streamsize>(pending.size()));
+            pending.clear();
+        }
+        if(!enabled_) {
+            lock_guard<mutex> lock(bufferMutex_);
+            if(buffer_.empty()) break;
+        }
+    }
+    traceFile_.flush();
+}
+
+void TraceRecorder::stop() {
+    if(enabled_) {
+        {
+            lock_guard<mutex> lock(bufferMutex_);
+            enabled_ = false;
+        }
+        cv_.notify_all();
+        if(writerThread_.joinable()) {
+            writerThread_.join();
+        }
+        traceFile_.close();
+    }
+}
+
+uint64_t TraceRecorder::sessionKey(const string& sessionId) {
+    // FNV-1a：跨平台稳定，trace中只保存会话ID的哈希
+    uint64_t hash = 14695981039346656037ull;
+    for(unsigned char c : sessionId) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash ? hash : 1;
+}
+
+bool TraceRecorder::readTrace(const string& path, vector<TraceRecord>& records) {
+    ifstream in(path, ios::binary | ios::ate);
+    if(!in.is_open()) {
+        cerr << "trace文件打开失败: " << path << endl;
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+
+    char magic[sizeof(TRACE_MAGIC)];
+    uint64_t wallClockNs;
+    if(!in.read(magic, sizeof(magic)) || !equal(magic, magic + sizeof(magic), TRACE_MAGIC) ||
+       in.get() != TRACE_VERSION ||
+       !in.read(reinterpret_cast<char*>(&wallClockNs), sizeof(wallClockNs))) {
+        cerr << "trace文件格式错误: " << path << endl;
+        return false;
+    }
+
+    uint64_t timestamp = 0;
+    while(true) {
+        int op = in.get();
+        if(op == EOF) break;
+        int flags = in.get();
+
+        TraceRecord record;
+        uint64_t delta, zigzag;
+        if(flags == EOF || !getVarint(in, delta)) break;
+        record.session = 0;
+        if((flags & FLAG_HAS_SESSION) &&
+           !in.read(reinterpret_cast<char*>(&record.session), sizeof(record.session))) break;
+        if(!getVarint(in, zigzag)) break;
+        if(!getString(in, record.subject, fileSize) || !getString(in, record.payload, fileSize)) break;
+
+        timestamp += delta;
+        record.timestampNs = timestamp;
+        record.op = static_cast<TraceOp>(op);
+        record.success = flags & FLAG_SUCCESS;
+        record.deviceId = static_cast<int>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+        records.push_back(move(record));
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <condition_variable>
+#include <cstdint>
+
+// 管理器调用流量录制：把登录、会话校验、设备添加和控制命令追加到紧凑的二进制trace文件，
+// 并在录制开始时写入已有设备的快照，
+// 供 tools/trace_replay 按原始节奏回放。未启用时每次调用只有一次原子读开销。
+// 文件格式：头部 "SHTR" + 版本 + 起始时间；每条记录为
+// [操作][标志][时间增量varint][会话键(可选8字节)][设备ID zigzag varint][subject][payload]
+class TraceRecorder {
+public:
+    enum class TraceOp : uint8_t {
+        LOGIN = 1,
+        VALIDATE_SESSION = 2,
+        ADD_DEVICE = 3,
+        SET_DEVICE_STATUS = 4,
+        DEVICE_SNAPSHOT = 5     // 录制开始时已存在的设备：deviceId为原ID，subject为类型，payload为状态
+    };
+
+    struct TraceRecord {
+        uint64_t timestampNs;   // 相对录制开始的纳秒数
+        TraceOp op;
+        bool success;
+        uint64_t session;       // 会话ID的哈希，0表示无会话；原始会话ID和密码不会写入trace
+        int deviceId;
+        std::string subject;    // 用户名或设备类型
+        std::string payload;    // 命令、设备配置/状态或登录IP
+    };
+
+    static TraceRecorder& getInstance();
+
+    bool start(const std::string& path, size_t maxBufferBytes = 64 * 1024 * 1024);
+    void stop();
+    bool isEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    void record(TraceOp op, bool success, uint64_t session, int deviceId,
+                const std::string& subject, const std::string& payload);
+
+    uint64_t droppedCount() const { return dropped_; }
+
+    static uint64_t sessionKey(const std::string& sessionId);
+    static bool readTrace(const std::string& path, std::vector<TraceRecord>& records);
+
+private:
+    TraceRecorder() = default;
+    ~TraceRecorder();
+
+    std::atomic<bool> enabled_{false};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::string buffer_;
+    size_t maxBufferBytes_ = 0;
+    std::chrono::steady_clock::time_point startTime_;
+    uint64_t lastTimestampNs_ = 0;
+    std::mutex bufferMutex_;
+    std::condition_variable cv_;
+
+    std::ofstream traceFile_;
+    std::thread writerThread_;
+
+    void writerFunction();
+};
+
+#endif // TRACE_RECORDER_H
@@ -1,42 +1,74 @@
 #include "UserManager/UserManager.h"
+#include "TraceRecorder/TraceRecorder.h"
 #include <ctime>
 #include <random>
 #include <sstream>
 #include <iomanip>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <openssl/crypto.h>
 #include <sqlite3.h>
 #include <algorithm>
+#include <iostream>
+#include <map>
+#include <array>
+#include <vector>
 
 using namespace std;
 
 // 登录失败锁定策略（5次失败锁定15分钟）
 constexpr int MAX_LOGIN_ATTEMPTS = 5;
 constexpr int LOCKOUT_DURATION = 900; 
+constexpr int SESSION_TIMEOUT = 1800;
 
 UserManager::UserManager(DatabaseManager& dbManager) : db_(dbManager) {}
 
+// PBKDF2-HMAC-SHA256参数，已存储的哈希按其自身记录的参数校验
+constexpr int PBKDF2_ITERATIONS = 10000;
+constexpr int PBKDF2_KEY_LENGTH = 32;
+constexpr int PBKDF2_MAX_ITERATIONS = 10'000'000;
+
+static bool deriveKey(const string& password, const vector<uint8_t>& salt, int iterations, vector<uint8_t>& key) {
+    return PKCS5_PBKDF2_HMAC(
+        password.c_str(), password.length(),
+        salt.data(), salt.size(),
+        iterations,
+        EVP_sha256(),
+        key.size(), key.data()
+    ) == 1;
+}
+
+static bool fromHex(const string& hex, vector<uint8_t>& bytes) {
+    if(hex.empty() || hex.size() % 2 != 0) return false;
+    bytes.resize(hex.size() / 2);
+    for(size_t i = 0; i < bytes.size(); ++i) {
+        int value = 0;
+        for(size_t k = 0; k < 2; ++k) {
+            char c = hex[i * 2 + k];
+            int digit = (c >= '0' && c <= '9') ? c - '0'
+                      : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                      : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if(digit < 0) return false;
+            value = value * 16 + digit;
+        }
+        bytes[i] = static_cast<uint8_t>(value);
+    }
+    return true;
+}
+
 string UserManager::hashPassword(const string& password) {
     // 生成随机盐值
     random_device rd;
-    array<uint8_t, 16> salt;
+    vector<uint8_t> salt(16);
     generate(salt.begin(), salt.end(), ref(rd));
 
     // 使用PBKDF2-HMAC-SHA256进行密钥派生
-    const int iterations = 10000;
-    const int keyLength = 32;
-    vector<uint8_t> derivedKey(keyLength);
-
-    PKCS5_PBKDF2_HMAC(
-        password.c_str(), password.length(),
-        salt.data(), salt.size(),
-        iterations,
-        EVP_sha256(),
-        keyLength, derivedKey.data()
-    );
+    vector<uint8_t> derivedKey(PBKDF2_KEY_LENGTH);
+    deriveKey(password, salt, PBKDF2_ITERATIONS, derivedKey);
 
     // 存储格式：算法$迭代次数$盐$密钥
     stringstream ss;
-    ss << "pbkdf2-sha256$" << iterations << "$";
+    ss << "pbkdf2-sha256$" << PBKDF2_ITERATIONS << "$";
     ss << hex << setfill('0');
     for(auto b : salt) ss << setw(2) << (int)b;
     ss << "$";
@@ -45,12 +77,40 @@ string UserManager::hashPassword(const string& password) {
     return ss.str();
 }
 
+bool UserManager::verifyPassword(const string& password, const string& storedHash) {
+    // 从存储的哈希中取出迭代次数和盐，用相同参数重新派生后比较
+    vector<string> parts;
+    stringstream ss(storedHash);
+    string part;
+    while(getline(ss, part, '$')) {
+        parts.push_back(part);
+    }
+    if(parts.size() != 4 || parts[0] != "pbkdf2-sha256") return false;
+    if(parts[1].empty() || parts[1].size() > 8 ||
+       !all_of(parts[1].begin(), parts[1].end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+
+    int iterations = stoi(parts[1]);
+    vector<uint8_t> salt, expected;
+    if(iterations <= 0 || iterations > PBKDF2_MAX_ITERATIONS) return false;
+    if(!fromHex(parts[2], salt) || !fromHex(parts[3], expected)) return false;
+
+    vector<uint8_t> derivedKey(expected.size());
+    if(!deriveKey(password, salt, iterations, derivedKey)) return false;
+
+    // 常量时间比较，避免通过响应时间逐字节猜测
+    return CRYPTO_memcmp(derivedKey.data(), expected.data(), expected.size()) == 0;
+}
+
 bool UserManager::registerUser(const string& username, const string& password, const string& role) {
     // 输入验证
     if(username.empty() || password.empty()) return false;
     if(role != "admin" && role != "user") return false;
 
-    lock_guard<mutex> lock(sessionMutex_);
+    // 哈希计算较慢，放在锁外
+    string hashedPassword = hashPassword(password);
+    lock_guard<mutex> lock(accountsMutex_);
     
     // 检查用户名是否已存在
     sqlite3_stmt* stmt;
@@ -74,7 +134,6 @@ bool UserManager::registerUser(const string& username, const string& password, c
         return false;
     }
 
-    string hashedPassword = hashPassword(password);
     sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 2, hashedPassword.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_text(stmt, 3, role.c_str(), -1, SQLITE_STATIC);
@@ -86,21 +145,75 @@ bool UserManager::registerUser(const string& username, const string& password, c
 }
 
 bool UserManager::login(const string& username, const string& password, const string& ip) {
-    lock_guard<mutex> lock(sessionMutex_);
-    clearExpiredSessions();
+    string sessionId;
+    return login(username, password, ip, sessionId);
+}
+
+bool UserManager::login(const string& username, const string& password, const string& ip, string& sessionId) {
+    bool success = authenticate(username, password, ip, sessionId);
 
+    // 只记录用户名、IP和会话ID哈希，不记录密码
+    auto& tracer = TraceRecorder::getInstance();
+    if(tracer.isEnabled()) {
+        tracer.record(TraceRecorder::TraceOp::LOGIN, success,
+                      success ? TraceRecorder::sessionKey(sessionId) : 0, -1, username, ip);
+    }
+    return success;
+}
+
+bool UserManager::authenticate(const string& username, const string& password, const string& ip, string& sessionId) {
     // 检查登录失败次数
-    static map<string, pair<int, time_t>> loginAttempts;
-    auto it = loginAttempts.find(username);
-    if(it != loginAttempts.end()) {
-        if(it->second.first >= MAX_LOGIN_ATTEMPTS && 
-           time(nullptr) - it->second.second < LOCKOUT_DURATION) 
-        {
-            cerr << "账户已锁定，请稍后再试" << endl;
+    {
+        lock_guard<mutex> lock(accountsMutex_);
+        auto it = loginAttempts_.find(username);
+        if(it != loginAttempts_.end()) {
+            if(it->second.first >= MAX_LOGIN_ATTEMPTS && 
+               time(nullptr) - it->second.second < LOCKOUT_DURATION) 
+            {
+                cerr << "账户已锁定，请稍后再试" << endl;
+                return false;
+            }
+        }
+    }
+
+    // 口令校验（数据库查询和PBKDF2）不持有会话锁，登录期间不阻塞其他会话的命令鉴权
+    string role;
+    bool verified = verifyCredentials(username, password, role);
+    {
+        lock_guard<mutex> lock(accountsMutex_);
+        if(!verified) {
+            auto& attempts = loginAttempts_[username];
+            attempts.first++;
+            attempts.second = time(nullptr);
             return false;
         }
+        // 重置登录失败计数
+        loginAttempts_.erase(username);
     }
 
+    // 设备权限在此一次性编译，后续鉴权不再访问数据库；编译期间授权若有变更，在锁内重新编译
+    uint64_t generation = permissionGeneration_.load();
+    auto permissions = compilePermissions(username, role);
+    string newSessionId = generateSessionId();
+    time_t now = time(nullptr);
+
+    unique_lock<shared_mutex> lock(sessionMutex_);
+    clearExpiredSessions();
+    if(permissionGeneration_.load() != generation) {
+        permissions = compilePermissions(username, role);
+    }
+    UserSession& session = activeSessions_[newSessionId];
+    session.username = username;
+    session.role = role;
+    session.ipAddress = ip;
+    session.loginTime = now;
+    session.lastActivity = now;
+    session.permissions = move(permissions);
+    sessionId = newSessionId;
+    return true;
+}
+
+bool UserManager::verifyCredentials(const string& username, const string& password, string& role) {
     // 查询用户信息
     sqlite3_stmt* stmt;
     const char* sql = "SELECT password_hash, role FROM users WHERE username = ?;";
@@ -112,68 +225,167 @@ bool UserManager::login(const string& username, const string& password, const st
 
     if(sqlite3_step(stmt) != SQLITE_ROW) {
         sqlite3_finalize(stmt);
-        loginAttempts[username].first++;
-        loginAttempts[username].second = time(nullptr);
         return false; // 用户不存在
     }
 
-    // 验证密码
     const char* storedHash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-    string inputHash = hashPassword(password);
-    
-    if(inputHash != storedHash) {
-        sqlite3_finalize(stmt);
-        loginAttempts[username].first++;
-        loginAttempts[username].second = time(nullptr);
-        return false;
-    }
-
-    // 获取用户角色
-    string role = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    const char* storedRole = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+    string hash = storedHash ? storedHash : "";
+    role = storedRole ? storedRole : "";
     sqlite3_finalize(stmt);
 
-    // 创建会话
-    string sessionId = generateSessionId();
-    activeSessions_[sessionId] = {
-        username,
-        role,
-        ip,
-        time(nullptr), // 登录时间
-        time(nullptr)  // 最后活动时间
-    };
-
-    // 重置登录失败计数
-    loginAttempts.erase(username);
-    return true;
+    // 验证密码
+    return !hash.empty() && verifyPassword(password, hash);
 }
 
 void UserManager::logout(const string& sessionId) {
-    lock_guard<mutex> lock(sessionMutex_);
+    unique_lock<shared_mutex> lock(sessionMutex_);
     activeSessions_.erase(sessionId);
 }
 
 bool UserManager::validateSession(const string& sessionId) {
-    lock_guard<mutex> lock(sessionMutex_);
-    auto it = activeSessions_.find(sessionId);
-    if(it == activeSessions_.end()) return false;
+    bool valid = checkSession(sessionId);
 
-    // 检查会话超时
-    if(time(nullptr) - it->second.lastActivity > SESSION_TIMEOUT) {
-        activeSessions_.erase(it);
-        return false;
+    auto& tracer = TraceRecorder::getInstance();
+    if(tracer.isEnabled()) {
+        tracer.record(TraceRecorder::TraceOp::VALIDATE_SESSION, valid,
+                      TraceRecorder::sessionKey(sessionId), -1, "", "");
     }
+    return valid;
+}
 
-    // 更新最后活动时间
-    it->second.lastActivity = time(nullptr);
-    return true;
+bool UserManager::checkSession(const string& sessionId) {
+    return getSessionPermissions(sessionId) != nullptr;
 }
 
 string UserManager::getCurrentUserRole(const string& sessionId) {
-    lock_guard<mutex> lock(sessionMutex_);
+    shared_lock<shared_mutex> lock(sessionMutex_);
     auto it = activeSessions_.find(sessionId);
     return (it != activeSessions_.end()) ? it->second.role : "";
 }
 
+shared_ptr<const DevicePermissions> UserManager::getSessionPermissions(const string& sessionId) {
+    string username;
+    return getSessionPermissions(sessionId, username);
+}
+
+shared_ptr<const DevicePermissions> UserManager::getSessionPermissions(const string& sessionId, string& username) {
+    time_t now = time(nullptr);
+    {
+        shared_lock<shared_mutex> lock(sessionMutex_);
+        auto it = activeSessions_.find(sessionId);
+        if(it == activeSessions_.end()) return nullptr;
+
+        if(now - it->second.lastActivity.load() <= SESSION_TIMEOUT) {
+            it->second.lastActivity = now;
+            username = it->second.username;
+            return it->second.permissions;
+        }
+    }
+
+    // 过期会话与已注销会话同样拒绝，改取独占锁删除（期间可能已被刷新，需重新检查）
+    unique_lock<shared_mutex> lock(sessionMutex_);
+    auto it = activeSessions_.find(sessionId);
+    if(it != activeSessions_.end() && now - it->second.lastActivity.load() > SESSION_TIMEOUT) {
+        activeSessions_.erase(it);
+    }
+    return nullptr;
+}
+
+shared_ptr<const DevicePermissions> UserManager::compilePermissions(const string& username, const string& role) {
+    auto permissions = make_shared<DevicePermissions>();
+
+    // 管理员拥有所有设备的全部操作权限
+    if(role == "admin") {
+        permissions->grantAll(DEVICE_OPERATION_ALL);
+        return permissions;
+    }
+
+    sqlite3_stmt* stmt;
+    const char* sql =
+        "SELECT device_id, operations FROM permissions "
+        "WHERE (subject_type = 'user' AND subject = ?) "
+        "OR (subject_type = 'role' AND subject = ?);";
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "数据库错误: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return permissions;
+    }
+    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, role.c_str(), -1, SQLITE_STATIC);
+
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        uint8_t operations = static_cast<uint8_t>(sqlite3_column_int(stmt, 1));
+        if(sqlite3_column_type(stmt, 0) == SQLITE_NULL) {
+            permissions->grantAll(operations);
+        } else {
+            permissions->grant(sqlite3_column_int(stmt, 0), operations);
+        }
+    }
+    sqlite3_finalize(stmt);
+    return permissions;
+}
+
+void UserManager::refreshSessionPermissions(const string& subjectType, const string& subject) {
+    for(auto& [sessionId, session] : activeSessions_) {
+        const string& key = (subjectType == "user") ? session.username : session.role;
+        if(key == subject) {
+            session.permissions = compilePermissions(session.username, session.role);
+        }
+    }
+    ++permissionGeneration_;
+}
+
+bool UserManager::grantPermission(const string& subjectType, const string& subject, int deviceId, uint8_t operations) {
+    if(subjectType != "user" && subjectType != "role") return false;
+    if(subject.empty() || (operations & DEVICE_OPERATION_ALL) == 0) return false;
+
+    unique_lock<shared_mutex> lock(sessionMutex_);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "INSERT INTO permissions (subject_type, subject, device_id, operations) VALUES (?, ?, ?, ?);";
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "数据库错误: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, subjectType.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, subject.c_str(), -1, SQLITE_STATIC);
+    if(deviceId < 0) {
+        sqlite3_bind_null(stmt, 3);
+    } else {
+        sqlite3_bind_int(stmt, 3, deviceId);
+    }
+    sqlite3_bind_int(stmt, 4, operations & DEVICE_OPERATION_ALL);
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+
+    if(success) {
+        refreshSessionPermissions(subjectType, subject);
+    }
+    return success;
+}
+
+bool UserManager::revokePermissions(const string& subjectType, const string& subject) {
+    unique_lock<shared_mutex> lock(sessionMutex_);
+
+    sqlite3_stmt* stmt;
+    const char* sql = "DELETE FROM permissions WHERE subject_type = ? AND subject = ?;";
+    if(sqlite3_prepare_v2(db_.getHandle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        cerr << "数据库错误: " << sqlite3_errmsg(db_.getHandle()) << endl;
+        return false;
+    }
+    sqlite3_bind_text(stmt, 1, subjectType.c_str(), -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, subject.c_str(), -1, SQLITE_STATIC);
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+
+    if(success) {
+        refreshSessionPermissions(subjectType, subject);
+    }
+    return success;
+}
+
 string UserManager::generateSessionId() {
     // 使用CryptoPP生成密码学安全的随机数
     random_device rd;
@@ -4,14 +4,21 @@
 #include <string>
 #include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <ctime>
 #include "DatabaseManager/DatabaseManager.h"
+#include "UserManager/DevicePermissions.h"
 
 struct UserSession {
     std::string username;
     std::string role;
     std::string ipAddress;
     time_t loginTime;
-    time_t lastActivity;
+    std::atomic<time_t> lastActivity{0};   // 鉴权时在共享锁下刷新
+    std::shared_ptr<const DevicePermissions> permissions;
 };
 
 class UserManager {
@@ -20,19 +27,38 @@ public:
     
     bool registerUser(const std::string& username, const std::string& password, const std::string& role);
     bool login(const std::string& username, const std::string& password, const std::string& ip);
+    bool login(const std::string& username, const std::string& password, const std::string& ip, std::string& sessionId);
     void logout(const std::string& sessionId);
     bool validateSession(const std::string& sessionId);
     std::string getCurrentUserRole(const std::string& sessionId);
+
+    // 设备权限管理（deviceId为-1表示所有设备），授权后立即刷新相关在线会话
+    bool grantPermission(const std::string& subjectType, const std::string& subject, int deviceId, uint8_t operations);
+    bool revokePermissions(const std::string& subjectType, const std::string& subject);
+    // 返回会话当前的权限（注销、过期后为空，授权变更后立即反映），同时刷新会话活动时间
+    std::shared_ptr<const DevicePermissions> getSessionPermissions(const std::string& sessionId);
+    std::shared_ptr<const DevicePermissions> getSessionPermissions(const std::string& sessionId, std::string& username);
     
 private:
     DatabaseManager& db_;
+    // 会话表：每次命令鉴权只取共享锁，登录、注销和授权变更取独占锁
     std::unordered_map<std::string, UserSession> activeSessions_;
-    std::mutex sessionMutex_;
+    std::shared_mutex sessionMutex_;
+    std::atomic<uint64_t> permissionGeneration_{0};   // 授权变更计数，登录时据此判断编译结果是否过时
+    // 账户注册和登录失败计数；口令哈希计算不持有任何锁
+    std::map<std::string, std::pair<int, time_t>> loginAttempts_;
+    std::mutex accountsMutex_;
     
+    bool verifyCredentials(const std::string& username, const std::string& password, std::string& role);
+    bool authenticate(const std::string& username, const std::string& password, const std::string& ip, std::string& sessionId);
+    bool checkSession(const std::string& sessionId);
     std::string generateSessionId();
     std::string hashPassword(const std::string& password);
+    bool verifyPassword(const std::string& password, const std::string& storedHash);
     void updateSessionActivity(const std::string& sessionId);
     void clearExpiredSessions();
+    std::shared_ptr<const DevicePermissions> compilePermissions(const std::string& username, const std::string& role);
+    void refreshSessionPermissions(const std::string& subjectType, const std::string& subject);
 };
 
 #endif // USER_MANAGER_H
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "DatabaseManager/DatabaseManager.h"
 #include "UserManager/UserManager.h"
 #include "DeviceManager/DeviceManager.h"
+#include "TraceRecorder/TraceRecorder.h"
+#include <cstdlib>
 #include <iostream>
 #include <string>
 #include <stdexcept>
@@ -8,8 +10,24 @@
 using namespace std;
 
 int main() {
+    // 设置 SMARTHOME_TRACE 环境变量时录制管理器调用，供 tools/trace_replay 回放
+    if(const char* tracePath = getenv("SMARTHOME_TRACE")) {
+        TraceRecorder::getInstance().start(tracePath);
+    }
+
+    // SMARTHOME_STORAGE=log 时设备状态使用日志结构存储，默认SQLite
+    StorageEngine engine = StorageEngine::SQLITE;
+    if(const char* storage = getenv("SMARTHOME_STORAGE")) {
+        string value = storage;
+        if(value == "log") {
+            engine = StorageEngine::LOG_STRUCTURED;
+        } else if(value != "sqlite") {
+            cerr << "未知存储引擎: " << value << "，使用sqlite" << endl;
+        }
+    }
+
     try {
-        DatabaseManager db("manage.db");
+        DatabaseManager db("manage.db", engine);
         UserManager userManager(db);
         
         // 注册示例
@@ -22,6 +40,7 @@ int main() {
         }
         
          DeviceManager deviceManager(db, "config/devices.json");
+         deviceManager.setUserManager(&userManager);
          // 添加新设备
          deviceManager.addDevice("light", R"({"brightness": 75})");
         
@@ -0,0 +1,362 @@
+#include "DatabaseManager/DatabaseManager.h"
+#include "UserManager/UserManager.h"
+#include "DeviceManager/DeviceManager.h"
+#include "TraceRecorder/TraceRecorder.h"
+#include "UserManager/DevicePermissions.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <array>
+#include <set>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using namespace std::chrono;
+
+using TraceOp = TraceRecorder::TraceOp;
+using TraceRecord = TraceRecorder::TraceRecord;
+
+// trace中不含密码，回放前用统一密码注册trace中出现的用户；录制时失败的登录用错误密码回放
+constexpr const char* REPLAY_PASSWORD = "trace-replay";
+constexpr const char* REPLAY_WRONG_PASSWORD = "trace-replay-wrong";
+constexpr size_t OP_COUNT = 6;
+
+struct ReplayStats {
+    array<vector<uint64_t>, OP_COUNT> latencies;   // 按操作类型，单位纳秒
+    array<uint64_t, OP_COUNT> failures{};
+    array<uint64_t, OP_COUNT> mismatches{};        // 回放结果与录制结果不一致的次数
+};
+
+// 所有回放线程共享的会话表：trace会话键 -> 回放时生成的会话ID（登录失败时为空）
+// 会话的登录可能落在其他线程，使用该会话的记录先等待对应登录回放完成
+class SessionTable {
+public:
+    explicit SessionTable(unordered_set<uint64_t> loginKeys) : loginKeys_(move(loginKeys)) {}
+
+    void put(uint64_t key, const string& sessionId) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            sessions_[key] = sessionId;
+        }
+        cv_.notify_all();
+    }
+
+    // trace中没有对应登录的会话键原样转成字符串，回放时必然校验失败，与录制时一致
+    string get(uint64_t key) {
+        if(!loginKeys_.count(key)) return to_string(key);
+        unique_lock<mutex> lock(mutex_);
+        cv_.wait(lock, [&] { return sessions_.count(key) > 0; });
+        const string& sessionId = sessions_[key];
+        return sessionId.empty() ? to_string(key) : sessionId;
+    }
+
+private:
+    const unordered_set<uint64_t> loginKeys_;
+    unordered_map<uint64_t, string> sessions_;
+    mutex mutex_;
+    condition_variable cv_;
+};
+
+// 录制时的设备ID -> 回放时的设备ID（添加失败时为-1）
+// 快照中的设备在回放前重建；录制时成功添加的设备可能落在其他线程，使用它的命令先等待添加回放完成
+class DeviceIdMap {
+public:
+    DeviceIdMap(unordered_set<int> addedIds, bool hasSnapshot)
+        : addedIds_(move(addedIds)), hasSnapshot_(hasSnapshot) {}
+
+    void put(int recordedId, int deviceId) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            ids_[recordedId] = deviceId;
+        }
+        cv_.notify_all();
+    }
+
+    // 快照和添加记录中都没有的ID在录制时就不存在，回放时映射为-1，与录制时一样失败；
+    // 没有快照的旧trace无法区分，原样使用（例如由--config创建的设备）
+    int get(int recordedId) {
+        unique_lock<mutex> lock(mutex_);
+        if(addedIds_.count(recordedId)) {
+            cv_.wait(lock, [&] { return ids_.count(recordedId) > 0; });
+        }
+        auto it = ids_.find(recordedId);
+        if(it != ids_.end()) return it->second;
+        return hasSnapshot_ ? -1 : recordedId;
+    }
+
+private:
+    const unordered_set<int> addedIds_;
+    const bool hasSnapshot_;
+    unordered_map<int, int> ids_;
+    mutex mutex_;
+    condition_variable cv_;
+};
+
+// 回放环境：共享的管理器、会话表、设备ID映射，以及添加设备后要授予的控制权限（按录制时的设备ID）
+struct ReplayContext {
+    UserManager& users;
+    DeviceManager& devices;
+    SessionTable& sessions;
+    DeviceIdMap& deviceIds;
+    const map<int, set<string>>& grants;
+};
+
+static void grantControl(ReplayContext& context, int recordedId, int deviceId) {
+    auto it = context.grants.find(recordedId);
+    if(it == context.grants.end()) return;
+    for(const auto& username : it->second) {
+        context.users.grantPermission("user", username, deviceId, operationMask(DeviceOperation::CONTROL));
+    }
+}
+
+static const char* opName(size_t op) {
+    switch(static_cast<TraceOp>(op)) {
+        case TraceOp::LOGIN:             return "login";
+        case TraceOp::VALIDATE_SESSION:  return "validateSession";
+        case TraceOp::ADD_DEVICE:        return "addDevice";
+        case TraceOp::SET_DEVICE_STATUS: return "setDeviceStatus";
+        case TraceOp::DEVICE_SNAPSHOT:   return "deviceSnapshot";
+        default:                         return "unknown";
+    }
+}
+
+static void usage() {
+    cerr << "用法: trace_replay <trace文件> [--speed <倍数|max>] [--threads <N>]\n"
+         << "                    [--db <新数据库路径>] [--storage sqlite|log] [--config <devices.json>]" << endl;
+}
+
+// 同一设备的命令、同一会话的登录与校验分到同一线程，保证回放顺序；设备添加统一在0号线程按原顺序执行。
+// 跨线程的会话和设备依赖由SessionTable、DeviceIdMap等待解决：等待的总是trace中更早的登录或添加，不会形成环
+static size_t partitionOf(const TraceRecord& record, size_t threads) {
+    switch(record.op) {
+        case TraceOp::ADD_DEVICE:
+            return 0;
+        case TraceOp::SET_DEVICE_STATUS:
+            return static_cast<size_t>(max(record.deviceId, 0)) % threads;
+        default:
+            return (record.session ? record.session : TraceRecorder::sessionKey(record.subject)) % threads;
+    }
+}
+
+static void replayPartition(const vector<const TraceRecord*>& records, ReplayContext& context,
+                            double speed, steady_clock::time_point start, ReplayStats& stats) {
+    for(const TraceRecord* record : records) {
+        if(speed > 0) {
+            this_thread::sleep_until(start + nanoseconds(static_cast<int64_t>(record->timestampNs / speed)));
+        }
+
+        // 等待会话和设备就绪不计入延迟
+        string sessionId;
+        if(record->op != TraceOp::LOGIN && record->session) {
+            sessionId = context.sessions.get(record->session);
+        }
+        int deviceId = -1;
+        if(record->op == TraceOp::SET_DEVICE_STATUS) {
+            deviceId = context.deviceIds.get(record->deviceId);
+        }
+
+        bool ok = false;
+        int newId = -1;
+        auto begin = steady_clock::now();
+        switch(record->op) {
+            case TraceOp::LOGIN: {
+                string newSessionId;
+                ok = context.users.login(record->subject, record->success ? REPLAY_PASSWORD : REPLAY_WRONG_PASSWORD,
+                                         record->payload, newSessionId);
+                if(record->session) context.sessions.put(record->session, ok ? newSessionId : "");
+                break;
+            }
+            case TraceOp::VALIDATE_SESSION:
+                ok = context.users.validateSession(sessionId);
+                break;
+            case TraceOp::ADD_DEVICE:
+                ok = context.devices.addDevice(record->subject, record->payload, newId);
+                break;
+            case TraceOp::SET_DEVICE_STATUS:
+                if(record->session) {
+                    ok = context.devices.setDeviceStatus(sessionId, deviceId, record->payload);
+                } else {
+                    ok = context.devices.setDeviceStatus(deviceId, record->payload);
+                }
+                break;
+            default:
+                continue;
+        }
+        uint64_t elapsed = duration_cast<nanoseconds>(steady_clock::now() - begin).count();
+
+        // 先授权再发布映射，等待该设备的命令看到的总是已授权的设备
+        if(record->op == TraceOp::ADD_DEVICE && record->deviceId >= 0) {
+            if(ok) grantControl(context, record->deviceId, newId);
+            context.deviceIds.put(record->deviceId, ok ? newId : -1);
+        }
+
+        size_t op = static_cast<size_t>(record->op);
+        if(op >= OP_COUNT) continue;
+        stats.latencies[op].push_back(elapsed);
+        if(!ok) ++stats.failures[op];
+        if(ok != record->success) ++stats.mismatches[op];
+    }
+}
+
+static double percentile(const vector<uint64_t>& sorted, double p) {
+    if(sorted.empty()) return 0;
+    size_t index = min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+    return sorted[index] / 1000.0;
+}
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        usage();
+        return 1;
+    }
+
+    string tracePath = argv[1];
+    double speed = 1.0;                 // 0 表示不限速
+    size_t threads = 1;
+    string dbPath = "replay.db";
+    string configPath;
+    StorageEngine engine = StorageEngine::SQLITE;
+
+    for(int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        if(i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        string value = argv[++i];
+        if(arg == "--speed") {
+            speed = (value == "max") ? 0 : stod(value);
+        } else if(arg == "--threads") {
+            threads = max<size_t>(1, stoul(value));
+        } else if(arg == "--db") {
+            dbPath = value;
+        } else if(arg == "--storage") {
+            engine = (value == "log") ? StorageEngine::LOG_STRUCTURED : StorageEngine::SQLITE;
+        } else if(arg == "--config") {
+            configPath = value;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    // 只回放到全新数据库，避免覆盖已有数据
+    if(filesystem::exists(dbPath)) {
+        cerr << "数据库已存在，请指定新的路径: " << dbPath << endl;
+        return 1;
+    }
+
+    vector<TraceRecord> records;
+    if(!TraceRecorder::readTrace(tracePath, records)) {
+        return 1;
+    }
+
+    try {
+        DatabaseManager db(dbPath, engine);
+        UserManager users(db);
+        DeviceManager devices(db, configPath);
+        devices.setUserManager(&users);
+
+        // trace不含角色和授权：按普通用户注册，并只授予录制时确实成功执行过的控制权限，
+        // 录制时被拒绝的命令在回放时同样会被拒绝；权限按录制时的设备ID收集，设备重建或添加后按新ID授予
+        set<string> usernames;
+        map<int, set<string>> grants;
+        unordered_set<uint64_t> loginKeys;
+        unordered_set<int> addedIds;
+        bool hasSnapshot = false;
+        for(const auto& record : records) {
+            if(record.op == TraceOp::LOGIN) {
+                usernames.insert(record.subject);
+                if(record.success && record.session) loginKeys.insert(record.session);
+            } else if(record.op == TraceOp::SET_DEVICE_STATUS && record.session && record.success) {
+                grants[record.deviceId].insert(record.subject);
+            } else if(record.op == TraceOp::ADD_DEVICE && record.success && record.deviceId >= 0) {
+                addedIds.insert(record.deviceId);
+            } else if(record.op == TraceOp::DEVICE_SNAPSHOT) {
+                hasSnapshot = true;
+            }
+        }
+        for(const auto& username : usernames) {
+            users.registerUser(username, REPLAY_PASSWORD, "user");
+        }
+        SessionTable sessions(move(loginKeys));
+        DeviceIdMap deviceIds(move(addedIds), hasSnapshot);
+        ReplayContext context{users, devices, sessions, deviceIds, grants};
+
+        // 没有快照的旧trace沿用原ID授权（设备由--config创建）
+        if(!hasSnapshot) {
+            for(const auto& [deviceId, subjects] : grants) {
+                grantControl(context, deviceId, deviceId);
+            }
+        }
+
+        // 录制开始前已存在的设备按快照中的状态重建，不计入回放统计
+        vector<vector<const TraceRecord*>> partitions(threads);
+        for(const auto& record : records) {
+            if(record.op != TraceOp::DEVICE_SNAPSHOT) {
+                partitions[partitionOf(record, threads)].push_back(&record);
+                continue;
+            }
+            int newId = -1;
+            if(devices.addDevice(record.subject, record.payload, newId)) {
+                grantControl(context, record.deviceId, newId);
+                deviceIds.put(record.deviceId, newId);
+            } else {
+                cerr << "快照设备重建失败: " << record.deviceId << " (" << record.subject << ")" << endl;
+                deviceIds.put(record.deviceId, -1);
+            }
+        }
+
+        vector<ReplayStats> stats(threads);
+        vector<thread> workers;
+        auto start = steady_clock::now();
+        for(size_t i = 0; i < threads; ++i) {
+            workers.emplace_back(replayPartition, cref(partitions[i]), ref(context), speed, start, ref(stats[i]));
+        }
+        for(auto& worker : workers) {
+            worker.join();
+        }
+        double seconds = duration<double>(steady_clock::now() - start).count();
+
+        cout << "回放 " << records.size() << " 条记录，耗时 " << fixed << setprecision(3) << seconds
+             << " 秒，吞吐 " << setprecision(1) << (seconds > 0 ? records.size() / seconds : 0) << " 次/秒" << endl;
+        // 表头用ASCII，setw按字节计宽，中文表头无法对齐
+        cout << left << setw(18) << "op" << right << setw(10) << "count" << setw(8) << "fail"
+             << setw(10) << "mismatch"
+             << setw(10) << "p50(us)" << setw(10) << "p90(us)" << setw(10) << "p99(us)"
+             << setw(11) << "p999(us)" << setw(10) << "max(us)" << endl;
+
+        for(size_t op = 1; op < OP_COUNT; ++op) {
+            vector<uint64_t> merged;
+            uint64_t failures = 0;
+            uint64_t mismatches = 0;
+            for(const auto& s : stats) {
+                merged.insert(merged.end(), s.latencies[op].begin(), s.latencies[op].end());
+                failures += s.failures[op];
+                mismatches += s.mismatches[op];
+            }
+            if(merged.empty()) continue;
+            sort(merged.begin(), merged.end());
+
+            cout << left << setw(18) << opName(op) << right << setw(10) << merged.size() << setw(8) << failures
+                 << setw(10) << mismatches
+                 << setprecision(1)
+                 << setw(10) << percentile(merged, 0.50) << setw(10) << percentile(merged, 0.90)
+                 << setw(10) << percentile(merged, 0.99) << setw(11) << percentile(merged, 0.999)
+                 << setw(10) << merged.back() / 1000.0 << endl;
+        }
+    } catch(const exception& e) {
+        cerr << "回放失败: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}